@@ -10,7 +10,7 @@ public class GLAppJNILib {
          System.loadLibrary("glappjni");
      }
 
-    public static native void init(AssetManager asset_manager);
+    public static native void init(AssetManager asset_manager, String cache_dir, int memory_class);
     public static native void moveCamera(float x, float y, float z);
     public static native void render();
     public static native void resize(int width, int height);
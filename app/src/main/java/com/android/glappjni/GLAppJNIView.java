@@ -18,6 +18,7 @@
 
 package com.android.glappjni;
 
+import android.app.ActivityManager;
 import android.content.Context;
 import android.graphics.PixelFormat;
 import android.opengl.GLSurfaceView;
@@ -192,7 +193,11 @@ class GLAppJNIView extends GLSurfaceView {
         public void onSurfaceCreated(GL10 gl, EGLConfig config)
         {
             AssetManager mgr = getResources().getAssets();
-            GLAppJNILib.init(mgr);
+            // Processed meshes are kept in the app cache directory between runs
+            String cache_dir = getContext().getCacheDir().getAbsolutePath();
+            // Heap size of the app in megabytes, the texture budget is a share of it
+            ActivityManager activity_manager = (ActivityManager) getContext().getSystemService(Context.ACTIVITY_SERVICE);
+            GLAppJNILib.init(mgr, cache_dir, activity_manager.getMemoryClass());
         }
     }
 }
@@ -3,36 +3,77 @@
 #ifndef _APPLICATION_H_
 #define _APPLICATION_H_
 
+#include <atomic>
 #include <cassert>
 
 #include "rapidxml.hpp"
 #include "rapidxml_utils.hpp"
 #include "rapidxml_print.hpp"
 
+#include "common/thread_pool.hpp"
 #include "graphics/camera.h"
 #include "graphics/gl_code.h"
+#include "graphics/gltf_factory.h"
+#include "graphics/model_registry.h"
+#include "graphics/scene_arena.h"
 #include "graphics/scene_graph.h"
+#include "graphics/transform_store.h"
 #include "graphics/wavefront_factory.h"
 #include "physics/simulation.h"
 
+// The default maximum number of bytes of decoded texture data waiting to be uploaded, 0 for no limit
+#ifndef TEXTURE_STREAMING_BUDGET
+#define TEXTURE_STREAMING_BUDGET (32 * 1024 * 1024)
+#endif
+
+// On Android the budget is this fraction of the memory class of the device
+#ifndef TEXTURE_STREAMING_MEMORY_CLASS_SHARE
+#define TEXTURE_STREAMING_MEMORY_CLASS_SHARE 8
+#endif
+
 class Application {
 public:
 	scenegraph::Node* scenegraph_root;
+	// Owns every node of scenegraph_root and of the loaded models, they are freed together when it is released
+	scenegraph::SceneArena scene_arena;
+	// Nodes of scenegraph_root by name, nodes are added and removed through it to keep it current
+	scenegraph::NodeIndex scene_index;
+	// Local and world matrices of the transform nodes of scenegraph_root, rebuilt when nodes are added or removed
+	TransformStore transforms;
 	Simulation* simulation;
 	Camera* camera;
-	std::map<std::string, Image*> images;
+	// Textures that have been requested but not decoded yet
+	std::vector<std::string> pending_textures;
+	std::set<std::string> requested_textures;
+	// Runs texture decoding and mesh loading on every core, decoded textures are uploaded by the renderer as they arrive
+	ThreadPool* worker_pool;
+	DecodedImageQueue decoded_images;
+	std::atomic<bool> cancel_decoding;
+	// Bounds the memory of images that are decoded but not uploaded yet
+	MemoryBudget texture_budget;
+	// Processed meshes are cached here, empty when caching is disabled
+	std::string mesh_cache_directory;
+	// Every placement of a model file shares the geometry loaded by its first placement
+	ModelRegistry* model_registry;
+	// Root of the placement made by each model element of the configuration
+	std::map<rapidxml::xml_node<>*, scenegraph::Node*> placements;
 	char* config_file_contents;
 
 	AssetManager* asset_manager;
 #if defined(__ANDROID__)
-	Application(AAssetManager* asset_manager);
+	// texture_budget_bytes bounds the decoded textures waiting to be uploaded
+	Application(AAssetManager* asset_manager, const char* cache_directory,
+			size_t texture_budget_bytes = TEXTURE_STREAMING_BUDGET);
 #else
-	Application();
+	explicit Application(size_t texture_budget_bytes = TEXTURE_STREAMING_BUDGET);
 #endif
 	~Application();
 	Node* parseXML(rapidxml::xml_document<>& doc);
 	void parseXMLNode(rapidxml::xml_node<>* xml_node,
 			scenegraph::Node* scene_node);
+	void prefetchXMLNode(rapidxml::xml_node<>* xml_node);
+	void requestTextures(const std::set<std::string>& textures);
+	void loadPendingTextures();
 	Node* loadXML(const char* xml_filename);
 	Node* loadResources();
 
@@ -41,7 +82,8 @@ public:
 
 	template<typename SceneGraphRenderer_T>
 	void render(SceneGraphRenderer_T* renderer) {
-		renderer->render(scenegraph_root, camera);
+		renderer->uploadTextures(decoded_images);
+		renderer->render(scenegraph_root, transforms, camera);
 	}
 
 	void resize(int width, int height);
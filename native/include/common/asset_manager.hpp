@@ -4,6 +4,9 @@
 #define _ASSET_MANAGER_HPP_
 
 #include "common/log.h"
+#include "common/async_asset_loader.hpp"
+#include "common/asset_pack.hpp"
+#include "common/asset_view.hpp"
 #include <cassert>
 #include <cstring>
 #include <string>
@@ -13,13 +16,55 @@
     #include <android/asset_manager_jni.h>
     class AssetManager {
         AAssetManager* mgr;
+        AssetPack pack;
+        AsyncAssetLoader async_loader;
+
+        bool mapPackedOrAsset(const char* path, AssetView& view) {
+            assert(mgr);
+            if (pack.find(path, view)) {
+                return true;
+            }
+            view.release();
+            AAsset* file = AAssetManager_open(mgr, path, AASSET_MODE_BUFFER);
+            if (file == 0) {
+                return false;
+            }
+            std::shared_ptr<void> owner(file, [](void* p) { AAsset_close((AAsset*) p); });
+            const void* buffer = AAsset_getBuffer(file);
+            if (buffer == 0) {
+                return false;
+            }
+            view.reset(owner, (const unsigned char*) buffer, (size_t) AAsset_getLength(file), false, false);
+            return true;
+        }
     public:
-        AssetManager(AAssetManager* _android_mgr) {
+        AssetManager(AAssetManager* _android_mgr, size_t num_io_threads = ASSET_IO_THREADS)
+        : async_loader(num_io_threads) {
             mgr = _android_mgr;
         }
 
+        // Start reading an asset on an I/O thread, a later mapAsset call for the same path
+        // waits for and uses the result
+        AssetFuture loadAsync(const char* path) {
+            return async_loader.load(path, [this](const char* p, AssetView& v) { return mapPackedOrAsset(p, v); });
+        }
+
+        // Serve assets from a pack built by asset_packer, the pack is itself an asset
+        bool openPack(const char* pack_filename) {
+            pack.close();
+            AssetView pack_view;
+            if (!mapAsset(pack_filename, pack_view)) {
+                return false;
+            }
+            return pack.open(pack_view, pack_filename);
+        }
+
         std::string loadTextFile(const char* path) {
             assert(mgr);
+            AssetView packed;
+            if (pack.find(path, packed)) {
+                return packed.toString();
+            }
             AAsset* file = AAssetManager_open(mgr, path, AASSET_MODE_BUFFER);
             // Get the file length
             size_t file_length = AAsset_getLength(file);
@@ -38,6 +83,10 @@
         }
 
         char* loadTextChars(const char* path) {
+            AssetView packed;
+            if (pack.find(path, packed)) {
+                return packed.copyChars();
+            }
             AAsset* file = AAssetManager_open(mgr, path, AASSET_MODE_BUFFER);
             // Get the file length
             size_t file_length = AAsset_getLength(file);
@@ -50,7 +99,22 @@
             return fileContent;
         }
 
+        // Map an asset without copying it, the view keeps the asset open until it is released.
+        // Assets are read-only, so copy_on_write is ignored and mutableChars() returns 0.
+        bool mapAsset(const char* path, AssetView& view, bool copy_on_write = false) {
+            (void) copy_on_write;
+            if (async_loader.take(path, view) && !view.empty()) {
+                return true;
+            }
+            return mapPackedOrAsset(path, view);
+        }
+
         unsigned char* loadBinaryFile(const char* filename, size_t& file_length) {
+            AssetView packed;
+            if (pack.find(filename, packed)) {
+                file_length = packed.size();
+                return packed.copyBytes();
+            }
             AAsset* file = AAssetManager_open(mgr, filename, AASSET_MODE_BUFFER);
             file_length = AAsset_getLength(file);
             if(file_length == 0) return 0;
@@ -69,8 +133,52 @@
 #include <vector>
 
 class AssetManager {
+    AssetPack pack;
+    AsyncAssetLoader async_loader;
+
+    bool mapPackedOrFile(const char* filename, AssetView& view, bool copy_on_write) {
+        if (pack.find(filename, view)) {
+            return true;
+        }
+        if (!AssetView::mapFile(filename, view, copy_on_write)) {
+            LOGI("Unable to open %s", filename);
+            return false;
+        }
+        return true;
+    }
 public:
+    AssetManager(size_t num_io_threads = ASSET_IO_THREADS) : async_loader(num_io_threads) {}
+
+    // Start reading a file on an I/O thread, a later mapAsset call for the same path
+    // waits for and uses the result
+    AssetFuture loadAsync(const char* filename) {
+        return async_loader.load(filename, [this](const char* p, AssetView& v) { return mapPackedOrFile(p, v, false); });
+    }
+
+    // Serve assets from a pack built by asset_packer instead of individual files
+    bool openPack(const char* pack_filename) {
+        pack.close();
+        AssetView pack_view;
+        if (!AssetView::mapFile(pack_filename, pack_view)) {
+            return false;
+        }
+        return pack.open(pack_view, pack_filename);
+    }
+
+    // Map a file without copying it, see AssetView::mapFile.
+    // Packed and prefetched assets are read-only, so copy_on_write does not apply to them.
+    bool mapAsset(const char* filename, AssetView& view, bool copy_on_write = false) {
+        if (!copy_on_write && async_loader.take(filename, view) && !view.empty()) {
+            return true;
+        }
+        return mapPackedOrFile(filename, view, copy_on_write);
+    }
+
     std::string loadTextFile(const char* filename) {
+        AssetView packed;
+        if (pack.find(filename, packed)) {
+            return packed.toString();
+        }
     	std::ifstream filestream(filename);
 		std::vector<char> buffer((std::istreambuf_iterator<char>(filestream)), std::istreambuf_iterator<char>());
 		filestream.close();
@@ -79,6 +187,10 @@ public:
 	}
 
 	char* loadTextChars(const char* path) {
+        AssetView packed;
+        if (pack.find(path, packed)) {
+            return packed.copyChars();
+        }
     	std::ifstream filestream(path);
     	if(!filestream.is_open()) {
     		LOGE("Unable to load %s, no data will be loaded", path);
@@ -94,6 +206,11 @@ public:
     }
 
     unsigned char* loadBinaryFile(const char* filename, size_t& file_length) {
+       AssetView packed;
+       if (pack.find(filename, packed)) {
+           file_length = packed.size();
+           return packed.copyBytes();
+       }
        std::ifstream filestream(filename, std::ios::in | std::ios::binary);
        file_length = 0;
        if (!filestream.is_open()) {
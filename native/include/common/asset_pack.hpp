@@ -0,0 +1,223 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _ASSET_PACK_HPP_
+#define _ASSET_PACK_HPP_
+
+// Single file asset pack: a header, an open addressing hash table of entries
+// keyed by asset path, a block of path names, and the file contents.
+// Contents start on ASSET_PACK_ALIGNMENT byte boundaries and are always followed
+// by at least one '\0' so text assets can be used as C strings in place.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "common/asset_view.hpp"
+#include "common/hash.hpp"
+#include "common/log.h"
+
+#define ASSET_PACK_MAGIC "DGPK"
+#define ASSET_PACK_VERSION 1
+#define ASSET_PACK_ALIGNMENT 16
+
+typedef struct AssetPackHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t num_entries;
+	// Size of the hash table, always a power of two
+	uint32_t num_slots;
+	uint64_t names_offset;
+	uint64_t names_length;
+} AssetPackHeader;
+
+// Slots with a name_length of 0 are empty
+typedef struct AssetPackEntry {
+	uint64_t hash;
+	uint64_t offset;
+	uint64_t length;
+	uint32_t name_offset;
+	uint32_t name_length;
+} AssetPackEntry;
+
+class AssetPack {
+public:
+	AssetPack() : header(0), entries(0), names(0) {}
+
+	bool isOpen() const { return header != 0; }
+
+	// Validate and index a view of a whole pack file, the pack keeps the view open
+	bool open(const AssetView& view, const char* pack_name) {
+		close();
+		if (view.size() < sizeof(AssetPackHeader)) {
+			LOGE("%s is not an asset pack", pack_name);
+			return false;
+		}
+		const AssetPackHeader* h = (const AssetPackHeader*) view.data();
+		if (0 != memcmp(h->magic, ASSET_PACK_MAGIC, 4) || h->version != ASSET_PACK_VERSION) {
+			LOGE("%s is not a version %i asset pack", pack_name, ASSET_PACK_VERSION);
+			return false;
+		}
+		size_t table_end = sizeof(AssetPackHeader) + (size_t) h->num_slots * sizeof(AssetPackEntry);
+		if (h->num_slots == 0 || (h->num_slots & (h->num_slots - 1)) != 0
+				|| table_end > view.size()
+				|| h->names_offset + h->names_length > view.size()) {
+			LOGE("Asset pack %s is corrupt", pack_name);
+			return false;
+		}
+		pack_view = view;
+		header = h;
+		entries = (const AssetPackEntry*) (view.data() + sizeof(AssetPackHeader));
+		names = view.chars() + h->names_offset;
+		LOGI("Opened asset pack %s with %u assets", pack_name, h->num_entries);
+		return true;
+	}
+
+	void close() {
+		pack_view.release();
+		header = 0;
+		entries = 0;
+		names = 0;
+	}
+
+	// Look up path in the hash table, the view shares the mapping of the pack
+	bool find(const char* path, AssetView& view) const {
+		if (header == 0) {
+			return false;
+		}
+		size_t path_length = strlen(path);
+		uint64_t h = fnv1a64(path, path_length);
+		uint32_t mask = header->num_slots - 1;
+		for (uint32_t i = 0; i < header->num_slots; i++) {
+			const AssetPackEntry* entry = &entries[(h + i) & mask];
+			if (entry->name_length == 0) {
+				return false;
+			}
+			if (entry->hash == h && entry->name_length == path_length
+					&& 0 == memcmp(names + entry->name_offset, path, path_length)) {
+				// The terminating '\0' must be inside the pack as well
+				if (entry->offset + entry->length >= pack_view.size()) {
+					LOGE("Asset pack entry %s is corrupt", path);
+					return false;
+				}
+				view = pack_view.subView((size_t) entry->offset, (size_t) entry->length, true);
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	AssetView pack_view;
+	const AssetPackHeader* header;
+	const AssetPackEntry* entries;
+	const char* names;
+};
+
+// Builds a pack in memory, used by the asset_packer tool
+class AssetPackWriter {
+public:
+	void add(const std::string& path, const std::vector<unsigned char>& contents) {
+		paths.push_back(path);
+		files.push_back(contents);
+	}
+
+	bool write(const char* pack_filename) {
+		uint32_t num_slots = 1;
+		// Keep the table at most half full so probe sequences stay short
+		while (num_slots < 2 * paths.size()) {
+			num_slots <<= 1;
+		}
+		std::vector<AssetPackEntry> table(num_slots);
+		memset(table.data(), 0, num_slots * sizeof(AssetPackEntry));
+
+		std::string name_block;
+		uint64_t offset = sizeof(AssetPackHeader) + num_slots * sizeof(AssetPackEntry);
+		uint64_t names_offset = offset;
+		for (size_t i = 0; i < paths.size(); i++) {
+			name_block.append(paths[i]);
+		}
+		offset = align(offset + name_block.size() + 1);
+
+		std::vector<uint64_t> file_offsets;
+		uint32_t name_offset = 0;
+		for (size_t i = 0; i < paths.size(); i++) {
+			AssetPackEntry entry;
+			entry.hash = fnv1a64(paths[i].data(), paths[i].size());
+			entry.offset = offset;
+			entry.length = files[i].size();
+			entry.name_offset = name_offset;
+			entry.name_length = (uint32_t) paths[i].size();
+			name_offset += entry.name_length;
+			file_offsets.push_back(offset);
+			// Leave room for the terminating '\0'
+			offset = align(offset + files[i].size() + 1);
+
+			uint32_t mask = num_slots - 1;
+			uint32_t slot = (uint32_t) (entry.hash & mask);
+			while (table[slot].name_length != 0) {
+				slot = (slot + 1) & mask;
+			}
+			table[slot] = entry;
+		}
+
+		AssetPackHeader header;
+		memcpy(header.magic, ASSET_PACK_MAGIC, 4);
+		header.version = ASSET_PACK_VERSION;
+		header.num_entries = (uint32_t) paths.size();
+		header.num_slots = num_slots;
+		header.names_offset = names_offset;
+		header.names_length = name_block.size();
+
+		FILE* file = fopen(pack_filename, "wb");
+		if (file == 0) {
+			LOGE("Unable to create %s", pack_filename);
+			return false;
+		}
+		uint64_t position = 0;
+		bool ok = writeBytes(file, &header, sizeof(header), position)
+				&& writeBytes(file, table.data(), num_slots * sizeof(AssetPackEntry), position)
+				&& writeBytes(file, name_block.data(), name_block.size(), position);
+		for (size_t i = 0; ok && i < files.size(); i++) {
+			ok = pad(file, file_offsets[i], position)
+					&& writeBytes(file, files[i].data(), files[i].size(), position);
+		}
+		ok = ok && pad(file, offset, position);
+		fclose(file);
+		if (!ok) {
+			LOGE("Unable to write %s", pack_filename);
+		}
+		return ok;
+	}
+
+private:
+	std::vector<std::string> paths;
+	std::vector<std::vector<unsigned char> > files;
+
+	static uint64_t align(uint64_t offset) {
+		return (offset + ASSET_PACK_ALIGNMENT - 1) & ~((uint64_t) ASSET_PACK_ALIGNMENT - 1);
+	}
+
+	static bool writeBytes(FILE* file, const void* data, size_t length, uint64_t& position) {
+		position += length;
+		return length == 0 || fwrite(data, 1, length, file) == length;
+	}
+
+	// Zero fill up to offset
+	static bool pad(FILE* file, uint64_t offset, uint64_t& position) {
+		static const unsigned char zeros[ASSET_PACK_ALIGNMENT] = { 0 };
+		while (position < offset) {
+			size_t n = (size_t) (offset - position);
+			if (n > ASSET_PACK_ALIGNMENT) {
+				n = ASSET_PACK_ALIGNMENT;
+			}
+			if (!writeBytes(file, zeros, n, position)) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+#endif // _ASSET_PACK_HPP_
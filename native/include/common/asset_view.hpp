@@ -0,0 +1,159 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _ASSET_VIEW_HPP_
+#define _ASSET_VIEW_HPP_
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define ASSET_VIEW_HAS_MMAP 1
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+// Read-only view of the bytes of an asset, usually backed by a memory mapping.
+// Copies share the same mapping, which is released when the last copy is destroyed.
+class AssetView {
+public:
+    AssetView() : bytes(0), length(0), writable(false), terminated(false) {}
+
+    const unsigned char* data() const { return bytes; }
+    const char* chars() const { return (const char*) bytes; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+
+    // True if a '\0' follows the last byte, so chars() can be used as a C string
+    bool isNullTerminated() const { return terminated; }
+
+    // Copy-on-write views can be modified in place (eg. by rapidxml) without changing the file,
+    // returns 0 for read-only views
+    char* mutableChars() const { return writable ? (char*) bytes : 0; }
+
+    // Read one byte of every page so a mapped file is loaded into memory by the calling thread
+    void prefetch() const {
+        volatile unsigned char sum = 0;
+        for (size_t i = 0; i < length; i += 4096) {
+            sum += bytes[i];
+        }
+        (void) sum;
+    }
+
+    // Copies of the contents for the copying AssetManager calls
+    std::string toString() const {
+        return std::string(chars(), length);
+    }
+
+    char* copyChars() const {
+        char* copy = new char[length + 1];
+        assert(copy);
+        memcpy(copy, bytes, length);
+        copy[length] = '\0';
+        return copy;
+    }
+
+    unsigned char* copyBytes() const {
+        if (length == 0) return 0;
+        unsigned char* copy = new unsigned char[length];
+        assert(copy);
+        memcpy(copy, bytes, length);
+        return copy;
+    }
+
+    // View of part of this view that shares the same mapping
+    AssetView subView(size_t offset, size_t sub_length, bool is_terminated) const {
+        AssetView view;
+        if (offset + sub_length <= length) {
+            view.reset(handle, bytes + offset, sub_length, false, is_terminated);
+        }
+        return view;
+    }
+
+    void release() {
+        handle.reset();
+        bytes = 0;
+        length = 0;
+        writable = false;
+        terminated = false;
+    }
+
+    // Create a view over memory owned by handle
+    void reset(std::shared_ptr<void> owner, const unsigned char* data_bytes, size_t data_length, bool is_writable, bool is_terminated) {
+        handle = owner;
+        bytes = data_bytes;
+        length = data_length;
+        writable = is_writable;
+        terminated = is_terminated;
+    }
+
+    // Copy the file contents to the heap, used where mapping is not available
+    static bool readFile(const char* path, AssetView& view) {
+        std::ifstream filestream(path, std::ios::in | std::ios::binary);
+        if (!filestream.is_open()) {
+            return false;
+        }
+        filestream.seekg(0, std::ios::end);
+        size_t file_length = (size_t) filestream.tellg();
+        filestream.seekg(0, std::ios::beg);
+        unsigned char* file_contents = new unsigned char[file_length + 1];
+        assert(file_contents);
+        filestream.read((char*) file_contents, file_length);
+        filestream.close();
+        file_contents[file_length] = '\0';
+        std::shared_ptr<void> owner(file_contents, [](void* p) { delete [] (unsigned char*) p; });
+        view.reset(owner, file_contents, file_length, true, true);
+        return true;
+    }
+
+    // Map a file from the local file system, with copy_on_write the pages are private and writable
+    static bool mapFile(const char* path, AssetView& view, bool copy_on_write = false) {
+        view.release();
+#if defined(ASSET_VIEW_HAS_MMAP)
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0) {
+            close(fd);
+            return false;
+        }
+        size_t file_length = (size_t) file_stat.st_size;
+        if (file_length == 0) {
+            close(fd);
+            return true;
+        }
+        int protection = copy_on_write ? (PROT_READ | PROT_WRITE) : PROT_READ;
+        void* mapping = mmap(0, file_length, protection, MAP_PRIVATE, fd, 0);
+        // The mapping stays valid after the descriptor is closed
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            return readFile(path, view);
+        }
+        std::shared_ptr<void> owner(mapping, [file_length](void* p) { munmap(p, file_length); });
+        // The remainder of the last page is zero filled, so the contents are terminated unless the
+        // file ends exactly on a page boundary
+        long page_size = sysconf(_SC_PAGESIZE);
+        bool is_terminated = page_size > 0 && (file_length % (size_t) page_size) != 0;
+        view.reset(owner, (const unsigned char*) mapping, file_length, copy_on_write, is_terminated);
+        return true;
+#else
+        (void) copy_on_write;
+        return readFile(path, view);
+#endif
+    }
+
+private:
+    std::shared_ptr<void> handle;
+    const unsigned char* bytes;
+    size_t length;
+    bool writable;
+    bool terminated;
+};
+
+#endif // _ASSET_VIEW_HPP_
@@ -0,0 +1,75 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _ASYNC_ASSET_LOADER_HPP_
+#define _ASYNC_ASSET_LOADER_HPP_
+
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "common/asset_view.hpp"
+#include "common/thread_pool.hpp"
+
+// The number of threads reading assets in the background
+#ifndef ASSET_IO_THREADS
+#define ASSET_IO_THREADS 4
+#endif
+
+// Completed with an empty view if the asset could not be loaded
+typedef std::shared_future<AssetView> AssetFuture;
+
+// Reads assets on a pool of I/O threads. Results are kept until they are taken,
+// so an AssetManager can hand a prefetched view to the code that maps the asset later.
+class AsyncAssetLoader {
+public:
+	explicit AsyncAssetLoader(size_t _num_threads) : num_threads(_num_threads) {}
+
+	// map_file(path, view) is called on an I/O thread, repeated requests for a path share the same future
+	template<typename MapFunction>
+	AssetFuture load(const std::string& path, MapFunction map_file) {
+		std::unique_lock<std::mutex> lock(mutex);
+		std::map<std::string, AssetFuture>::iterator it = pending.find(path);
+		if (it != pending.end()) {
+			return it->second;
+		}
+		if (!pool) {
+			pool.reset(new ThreadPool(num_threads));
+		}
+		AssetFuture future = pool->submit([path, map_file]() {
+			AssetView view;
+			if (map_file(path.c_str(), view)) {
+				// Fault the pages in now instead of when the contents are first used
+				view.prefetch();
+			}
+			return view;
+		}).share();
+		pending.insert(std::make_pair(path, future));
+		return future;
+	}
+
+	// Wait for and remove the result of an earlier load, returns false if path was not requested
+	bool take(const std::string& path, AssetView& view) {
+		AssetFuture future;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			std::map<std::string, AssetFuture>::iterator it = pending.find(path);
+			if (it == pending.end()) {
+				return false;
+			}
+			future = it->second;
+			pending.erase(it);
+		}
+		view = future.get();
+		return true;
+	}
+
+private:
+	size_t num_threads;
+	std::unique_ptr<ThreadPool> pool;
+	std::map<std::string, AssetFuture> pending;
+	std::mutex mutex;
+};
+
+#endif // _ASYNC_ASSET_LOADER_HPP_
@@ -0,0 +1,34 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _CONCURRENT_QUEUE_HPP_
+#define _CONCURRENT_QUEUE_HPP_
+
+#include <deque>
+#include <mutex>
+
+// Mutex protected FIFO used to hand results from worker threads to the GL thread
+template<typename T>
+class ConcurrentQueue {
+public:
+	void push(const T& item) {
+		std::unique_lock<std::mutex> lock(mutex);
+		items.push_back(item);
+	}
+
+	// Never blocks, returns false if the queue is empty
+	bool tryPop(T& item) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (items.empty()) {
+			return false;
+		}
+		item = items.front();
+		items.pop_front();
+		return true;
+	}
+
+private:
+	std::deque<T> items;
+	std::mutex mutex;
+};
+
+#endif // _CONCURRENT_QUEUE_HPP_
@@ -0,0 +1,103 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _FLAT_INDEX_MAP_HPP_
+#define _FLAT_INDEX_MAP_HPP_
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+#define FLAT_INDEX_MAP_EMPTY_SLOT 0xFFFFFFFFu
+
+// Assigns consecutive indices to distinct keys. The slots are an open addressing table with
+// linear probing that holds indices into a dense array of keys, so a lookup touches one
+// contiguous run of 4-byte slots and nothing is allocated per key.
+template<typename Key, typename Hash, typename Equal>
+class FlatIndexMap {
+public:
+	// Sized for max_keys up front, inserting more keys rebuilds the table larger
+	explicit FlatIndexMap(size_t max_keys = 0) {
+		reserve(max_keys);
+	}
+
+	void reserve(size_t max_keys) {
+		size_t capacity = 16;
+		// Keep the load factor at or below one half
+		while (capacity < max_keys * 2) {
+			capacity <<= 1;
+		}
+		if (capacity <= slots.size()) {
+			return;
+		}
+		mask = capacity - 1;
+		slots.assign(capacity, FLAT_INDEX_MAP_EMPTY_SLOT);
+		keys.reserve(max_keys);
+		for (size_t i = 0; i < keys.size(); i++) {
+			size_t slot = (size_t) hash(keys[i]) & mask;
+			while (slots[slot] != FLAT_INDEX_MAP_EMPTY_SLOT) {
+				slot = (slot + 1) & mask;
+			}
+			slots[slot] = (uint32_t) i;
+		}
+	}
+
+	// Returns the index of key, a new key gets the next index and sets inserted
+	uint32_t insert(const Key& key, bool& inserted) {
+		if ((keys.size() + 1) * 2 > slots.size()) {
+			reserve(keys.size() * 2 + 1);
+		}
+		size_t slot = (size_t) hash(key) & mask;
+		while (true) {
+			uint32_t index = slots[slot];
+			if (index == FLAT_INDEX_MAP_EMPTY_SLOT) {
+				index = (uint32_t) keys.size();
+				slots[slot] = index;
+				keys.push_back(key);
+				inserted = true;
+				return index;
+			}
+			if (equal(keys[index], key)) {
+				inserted = false;
+				return index;
+			}
+			slot = (slot + 1) & mask;
+		}
+	}
+
+	// Finds the index of key without inserting it, returns false if key has none
+	bool find(const Key& key, uint32_t& index) const {
+		if (slots.empty()) {
+			return false;
+		}
+		size_t slot = (size_t) hash(key) & mask;
+		while (true) {
+			uint32_t found = slots[slot];
+			if (found == FLAT_INDEX_MAP_EMPTY_SLOT) {
+				return false;
+			}
+			if (equal(keys[found], key)) {
+				index = found;
+				return true;
+			}
+			slot = (slot + 1) & mask;
+		}
+	}
+
+	size_t size() const {
+		return keys.size();
+	}
+
+	// Keys in the order their indices were assigned
+	const std::vector<Key>& getKeys() const {
+		return keys;
+	}
+
+private:
+	std::vector<uint32_t> slots;
+	std::vector<Key> keys;
+	size_t mask;
+	Hash hash;
+	Equal equal;
+};
+
+#endif // _FLAT_INDEX_MAP_HPP_
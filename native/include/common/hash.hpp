@@ -0,0 +1,73 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _HASH_HPP_
+#define _HASH_HPP_
+
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+#define FNV1A_64_OFFSET_BASIS 14695981039346656037ULL
+#define FNV1A_64_PRIME 1099511628211ULL
+
+// 64-bit FNV-1a hash, seed can be the result of a previous call to hash data in pieces
+inline uint64_t fnv1a64(const void* data, size_t length, uint64_t seed = FNV1A_64_OFFSET_BASIS) {
+	const unsigned char* bytes = (const unsigned char*) data;
+	uint64_t h = seed;
+	for (size_t i = 0; i < length; i++) {
+		h ^= (uint64_t) bytes[i];
+		h *= FNV1A_64_PRIME;
+	}
+	return h;
+}
+
+// 64-bit MurmurHash2 (MurmurHash64A by Austin Appleby), reads 8 bytes at a time for hashing large files
+inline uint64_t murmur64(const void* data, size_t length, uint64_t seed = 0) {
+	const uint64_t m = 0xc6a4a7935bd1e995ULL;
+	const int r = 47;
+	uint64_t h = seed ^ (length * m);
+	const unsigned char* bytes = (const unsigned char*) data;
+	const unsigned char* end = bytes + (length / 8) * 8;
+	while (bytes != end) {
+		uint64_t k;
+		memcpy(&k, bytes, 8);
+		bytes += 8;
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+		h ^= k;
+		h *= m;
+	}
+	switch (length & 7) {
+	case 7: h ^= (uint64_t) bytes[6] << 48;
+		// fall through
+	case 6: h ^= (uint64_t) bytes[5] << 40;
+		// fall through
+	case 5: h ^= (uint64_t) bytes[4] << 32;
+		// fall through
+	case 4: h ^= (uint64_t) bytes[3] << 24;
+		// fall through
+	case 3: h ^= (uint64_t) bytes[2] << 16;
+		// fall through
+	case 2: h ^= (uint64_t) bytes[1] << 8;
+		// fall through
+	case 1: h ^= (uint64_t) bytes[0];
+		h *= m;
+	}
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+	return h;
+}
+
+// Finalizer of MurmurHash3, spreads the bits of a 64-bit key for use in hash tables
+inline uint64_t mix64(uint64_t k) {
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+#endif // _HASH_HPP_
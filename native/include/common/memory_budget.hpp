@@ -0,0 +1,64 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _MEMORY_BUDGET_HPP_
+#define _MEMORY_BUDGET_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+// Limits the number of bytes held by work in flight, such as decoded images waiting to be
+// uploaded. acquire() blocks until enough has been released; a single request larger than
+// the whole budget is allowed once nothing else is held. A limit of 0 means unlimited.
+class MemoryBudget {
+public:
+	explicit MemoryBudget(size_t _limit) : limit(_limit), in_use(0), peak(0), cancelled(false) {}
+
+	// Returns false without acquiring anything if the budget was cancelled
+	bool acquire(size_t bytes) {
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [this, bytes]() {
+			return cancelled || limit == 0 || in_use == 0 || in_use + bytes <= limit;
+		});
+		if (cancelled) {
+			return false;
+		}
+		in_use += bytes;
+		if (in_use > peak) {
+			peak = in_use;
+		}
+		return true;
+	}
+
+	void release(size_t bytes) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			in_use = bytes > in_use ? 0 : in_use - bytes;
+		}
+		condition.notify_all();
+	}
+
+	// Wake every waiting thread and fail all further requests
+	void cancel() {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cancelled = true;
+		}
+		condition.notify_all();
+	}
+
+	size_t peakBytes() {
+		std::unique_lock<std::mutex> lock(mutex);
+		return peak;
+	}
+
+private:
+	size_t limit;
+	size_t in_use;
+	size_t peak;
+	bool cancelled;
+	std::mutex mutex;
+	std::condition_variable condition;
+};
+
+#endif // _MEMORY_BUDGET_HPP_
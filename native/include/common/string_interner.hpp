@@ -0,0 +1,99 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _STRING_INTERNER_HPP_
+#define _STRING_INTERNER_HPP_
+
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <stdint.h>
+
+#include "common/flat_index_map.hpp"
+#include "common/hash.hpp"
+
+// Identifies an interned string, equal strings have equal ids
+typedef uint32_t NameId;
+
+// The id of the empty string
+#define EMPTY_NAME_ID 0
+
+// Gives every distinct string a 32-bit id, so names are stored and compared as integers.
+// Strings are kept until the program exits. It is safe to use from several threads.
+class StringInterner {
+public:
+	// Shared by the scene graph and the simulation
+	static StringInterner& global() {
+		static StringInterner interner;
+		return interner;
+	}
+
+	StringInterner() {
+		intern("", 0);
+	}
+
+	NameId intern(const char* chars, size_t length) {
+		std::lock_guard<std::mutex> lock(mutex);
+		Piece piece = { chars, length };
+		uint32_t id;
+		if (ids.find(piece, id)) {
+			return id;
+		}
+		// The map keeps a piece of the stored copy
+		strings.push_back(std::string(chars, length));
+		piece.chars = strings.back().data();
+		bool inserted;
+		return ids.insert(piece, inserted);
+	}
+
+	NameId intern(const std::string& s) {
+		return intern(s.data(), s.length());
+	}
+
+	// Finds the id of a string without interning it, returns false if it was never interned
+	bool lookup(const char* chars, size_t length, NameId& id) const {
+		std::lock_guard<std::mutex> lock(mutex);
+		Piece piece = { chars, length };
+		return ids.find(piece, id);
+	}
+
+	bool lookup(const std::string& s, NameId& id) const {
+		return lookup(s.data(), s.length(), id);
+	}
+
+	// The returned string stays valid while other strings are interned
+	const std::string& str(NameId id) const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return strings.at(id);
+	}
+
+	size_t size() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return strings.size();
+	}
+
+private:
+	typedef struct Piece {
+		const char* chars;
+		size_t length;
+	} Piece;
+
+	struct PieceHash {
+		uint64_t operator()(const Piece& piece) const {
+			return fnv1a64(piece.chars, piece.length);
+		}
+	};
+
+	struct PieceEqual {
+		bool operator()(const Piece& a, const Piece& b) const {
+			return a.length == b.length && memcmp(a.chars, b.chars, a.length) == 0;
+		}
+	};
+
+	mutable std::mutex mutex;
+	// A deque does not move its strings when it grows, so the pieces keep pointing at them
+	std::deque<std::string> strings;
+	FlatIndexMap<Piece, PieceHash, PieceEqual> ids;
+};
+
+#endif // _STRING_INTERNER_HPP_
@@ -0,0 +1,93 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _THREAD_POOL_HPP_
+#define _THREAD_POOL_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed size pool of worker threads running tasks in submission order.
+// Tasks that are still queued when the pool is destroyed are run before the workers exit.
+class ThreadPool {
+public:
+	explicit ThreadPool(size_t num_threads) : stopping(false) {
+		if (num_threads == 0) {
+			num_threads = 1;
+		}
+		for (size_t i = 0; i < num_threads; i++) {
+			workers.push_back(std::thread(&ThreadPool::run, this));
+		}
+	}
+
+	~ThreadPool() {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		condition.notify_all();
+		for (std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); ++it) {
+			it->join();
+		}
+	}
+
+	size_t size() const {
+		return workers.size();
+	}
+
+	// Number of threads to use for CPU bound work
+	static size_t hardwareThreads() {
+		unsigned n = std::thread::hardware_concurrency();
+		return n > 0 ? (size_t) n : 2;
+	}
+
+	template<typename Function>
+	std::future<typename std::result_of<Function()>::type> submit(Function function) {
+		typedef typename std::result_of<Function()>::type Result;
+		// std::function must be copyable, so the task is shared
+		std::shared_ptr<std::packaged_task<Result()> > task =
+				std::make_shared<std::packaged_task<Result()> >(function);
+		std::future<Result> result = task->get_future();
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			tasks.push_back([task]() { (*task)(); });
+		}
+		condition.notify_one();
+		return result;
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()> > tasks;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stopping;
+
+	// Prevent copying
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	void run() {
+		for (;;) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+				if (tasks.empty()) {
+					return;
+				}
+				task = tasks.front();
+				tasks.pop_front();
+			}
+			task();
+		}
+	}
+};
+
+#endif // _THREAD_POOL_HPP_
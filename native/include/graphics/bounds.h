@@ -0,0 +1,14 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _BOUNDS_H_
+#define _BOUNDS_H_
+
+#include "graphics/scene_graph.h"
+
+// Sets the axis aligned box and bounding sphere of a node from its float vertices. The box
+// and the extreme points along each axis are found in one SIMD pass, then a second pass grows a
+// Ritter sphere from the most distant pair of extremes. The box's circumscribed sphere is used
+// instead when it is smaller.
+void computeBounds(scenegraph::GeometryNode* geom_node);
+
+#endif //_BOUNDS_H_
@@ -21,6 +21,9 @@ public:
 	glm::vec3 up;
 	double horizontal_angle;
 	double vertical_angle;
+	// Size of the viewport in pixels, set when the window is resized
+	int viewport_width;
+	int viewport_height;
 
 	void aim(double x, double y);
 	void moveForward(double amount);
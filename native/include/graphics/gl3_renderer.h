@@ -15,13 +15,28 @@ protected:
 	std::map<GeometryNode*, GLuint> ibos;
 	std::map<std::string, GLuint> texture_ids;
 	GLuint matrix_uniform_location;
+	// Product of the transform nodes above the node being drawn
+	glm::mat4 model_matrix;
+	// Transforms of the frame being drawn and the occurrence of the next transform node visited
+	const TransformStore* transforms;
+	size_t next_transform;
+	// World space planes of the view frustum
+	float view_planes[6][4];
+	// Reused between draws to avoid allocating
+	std::vector<IndexRange> draw_ranges;
+	GLint position_scale_uniform_location, packed_normal_uniform_location;
 
 	void walk_init_buffers(Node* node);
-	void walk_render(Node* node);
+	void walk_render(Node* node, Camera* camera);
+	// A null material binds no texture
+	void bindMaterial(MaterialNode* material_node);
+	void drawRanges(GeometryNode* geometry_node, GLuint first, GLuint end);
 public:
-	GL3SceneGraphRenderer(std::map<std::string, Image*>& texture_names);
+	GL3SceneGraphRenderer();
 	~GL3SceneGraphRenderer();
-	void render(Node* node, Camera* camera);
+	// World matrices are read from transform_store, which must have been built from node
+	void render(Node* node, const TransformStore& transform_store, Camera* camera);
+	void uploadTextures(DecodedImageQueue& decoded_images);
 };
 
 #endif // _GL3_RENDERER_H_
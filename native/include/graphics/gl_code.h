@@ -4,6 +4,8 @@
 #define _GL2_CODE_H_
 
 #include "common/asset_manager.hpp"
+#include "common/concurrent_queue.hpp"
+#include "common/memory_budget.hpp"
 #include "common/log.h"
 
 #if defined(__ANDROID__)
@@ -19,6 +21,8 @@
 
 #include <cstdlib>
 #include <cmath>
+#include <string>
+#include <utility>
 
 #ifndef M_PI
 	#define M_PI 3.14159265358979323846
@@ -29,13 +33,19 @@
 typedef struct Image {
 	int w, h, comp;
 	unsigned char* data;
-	Image(const char *filename, AssetManager *manager);
+	// The decoded pixels are counted against budget until the image is destroyed
+	MemoryBudget* budget;
+	size_t budget_bytes;
+	Image(const char *filename, AssetManager *manager, MemoryBudget* budget = 0);
 	Image();
 	~Image();
 	bool loadAsset(const char *filename, AssetManager *manager);
 	GLuint loadTexture();
 } Image;
 
+// Images decoded on worker threads, waiting to be uploaded by the GL thread
+typedef ConcurrentQueue<std::pair<std::string, Image*> > DecodedImageQueue;
+
 GLuint createProgram(const char* vertex_source, const char* fragment_source);
 
 #define BUFFER_OFFSET(x)((char *)NULL+(x))
@@ -0,0 +1,48 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _GLTF_FACTORY_H_
+#define _GLTF_FACTORY_H_
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+
+#include "common/asset_manager.hpp"
+#include "graphics/gltf_parser.h"
+#include "graphics/scene_arena.h"
+#include "graphics/scene_graph.h"
+
+using namespace scenegraph;
+
+// Builds scene graph nodes from binary glTF files. Their geometry is expected to be optimized
+// when it is exported, so it is copied into the nodes without being welded, reordered or simplified.
+class GltfSceneGraphFactory {
+public:
+	// Nodes are created in the optional arena
+	GltfSceneGraphFactory(SceneArena* arena = 0);
+	~GltfSceneGraphFactory();
+	// The nodes of the default scene are added below a transform by matrix
+	bool addGltf(const char* gltf_filename, glm::mat4 matrix, AssetManager* asset_manager);
+	Node* build();
+	std::set<std::string> gltf_files;
+	std::set<std::string> textures;
+	// Layout of the vertices of meshes built after it is set
+	VertexFormat vertex_format;
+private:
+	std::string name;
+	SceneArena* arena;
+	std::vector<Node*> roots;
+	// Primitives of each mesh of the file being added, built by the first node that references it
+	std::vector<std::vector<Node*> > mesh_primitives;
+	std::vector<bool> built_meshes;
+
+	// on_path marks the nodes being built above node_index, so cyclic files cannot recurse forever
+	Node* buildNode(const gltf::Document& document, int node_index, const std::string& directory,
+			std::vector<bool>& on_path);
+	Node* buildPrimitive(const gltf::Document& document, const gltf::Primitive& primitive,
+			const std::string& primitive_name, const std::string& directory);
+};
+
+#endif //_GLTF_FACTORY_H_
@@ -0,0 +1,95 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _GLTF_PARSER_H_
+#define _GLTF_PARSER_H_
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Parses binary glTF 2.0 (.glb) files in place, the buffer views point into the parsed data
+namespace gltf {
+
+// Accessor component types
+#define GLTF_BYTE 5120
+#define GLTF_UNSIGNED_BYTE 5121
+#define GLTF_SHORT 5122
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT 5125
+#define GLTF_FLOAT 5126
+
+// Primitive modes
+#define GLTF_TRIANGLES 4
+
+// Views of buffers other than the binary chunk are empty, external buffers are not supported
+typedef struct BufferView {
+	size_t byte_offset;
+	size_t byte_length;
+	// 0 when the elements are tightly packed
+	size_t byte_stride;
+} BufferView;
+
+typedef struct Accessor {
+	// -1 when the accessor has no data, all of its elements are zero
+	int buffer_view;
+	size_t byte_offset;
+	int component_type;
+	// Number of components of one element, 1 for SCALAR up to 16 for MAT4
+	int components;
+	bool normalized;
+	size_t count;
+} Accessor;
+
+// Accessor indices of the attributes of a primitive, -1 when the attribute is not present
+typedef struct Primitive {
+	int position;
+	int normal;
+	int texcoord;
+	int indices;
+	int material;
+	int mode;
+} Primitive;
+
+typedef struct Mesh {
+	std::string name;
+	std::vector<Primitive> primitives;
+} Mesh;
+
+typedef struct Node {
+	std::string name;
+	// -1 when the node only transforms its children
+	int mesh;
+	std::vector<int> children;
+	// Column major local transform, composed from the translation, rotation and scale if needed
+	float matrix[16];
+} Node;
+
+typedef struct Material {
+	std::string name;
+	// Image file of the base color texture, empty when there is none or it is embedded
+	std::string diffuse_texname;
+} Material;
+
+// Result of parsing a .glb file, binary points into the parsed data
+typedef struct Document {
+	std::vector<BufferView> buffer_views;
+	std::vector<Accessor> accessors;
+	std::vector<Mesh> meshes;
+	std::vector<Node> nodes;
+	std::vector<Material> materials;
+	// Root nodes of the default scene
+	std::vector<int> scene_nodes;
+	const unsigned char* binary;
+	size_t binary_length;
+} Document;
+
+bool parseGlb(const unsigned char* data, size_t length, Document& document);
+// Returns the first element of an accessor and the distance between elements in stride,
+// 0 when the accessor has no data or its elements do not fit in the binary chunk
+const unsigned char* accessorData(const Document& document, const Accessor& accessor, size_t& stride);
+size_t componentSize(int component_type);
+
+} // namespace gltf
+
+#endif //_GLTF_PARSER_H_
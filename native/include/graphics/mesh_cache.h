@@ -0,0 +1,40 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _MESH_CACHE_H_
+#define _MESH_CACHE_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "graphics/scene_arena.h"
+#include "graphics/scene_graph.h"
+
+// Increase whenever the processed mesh data or the file layout changes
+#define MESH_CACHE_VERSION 11
+#define MESH_CACHE_MAGIC "DGMC"
+
+// Processed output of one wavefront file, as stored in the cache.
+// geometry_materials holds the index of each geometry node's material in materials, or -1,
+// the submesh materials of the nodes must also be in materials.
+typedef struct CachedMesh {
+	std::vector<scenegraph::MaterialNode*> materials;
+	std::vector<scenegraph::GeometryNode*> geometry_nodes;
+	std::vector<int> geometry_materials;
+} CachedMesh;
+
+// Stores processed meshes in files named by the hash of their source files, so a source
+// that has not changed is loaded by mapping the cache file instead of parsing it again
+class MeshCache {
+public:
+	MeshCache(const std::string& directory);
+	bool enabled() const;
+	// Allocates the nodes in mesh from the optional arena, returns false if there is no valid cache entry for key
+	bool load(uint64_t key, CachedMesh& mesh, scenegraph::SceneArena* arena = 0) const;
+	bool save(uint64_t key, const CachedMesh& mesh) const;
+private:
+	std::string directory;
+	std::string path(uint64_t key) const;
+};
+
+#endif // _MESH_CACHE_H_
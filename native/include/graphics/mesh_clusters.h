@@ -0,0 +1,33 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _MESH_CLUSTERS_H_
+#define _MESH_CLUSTERS_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "graphics/gl_code.h"
+#include "graphics/scene_graph.h"
+
+// Limits of one cluster, a cluster ends when either is reached
+#ifndef MESH_CLUSTER_MAX_TRIANGLES
+#define MESH_CLUSTER_MAX_TRIANGLES 128
+#endif
+#ifndef MESH_CLUSTER_MAX_VERTICES
+#define MESH_CLUSTER_MAX_VERTICES 64
+#endif
+
+// Splits the full detail triangles of a node built in index_data and vertex_data into clusters,
+// keeping the triangle order so the vertex cache optimization is preserved
+void buildClusters(scenegraph::GeometryNode* geom_node);
+// Planes of the clip space frustum transformed by clip, normalized so they give distances
+void extractFrustumPlanes(const glm::mat4& clip, float planes[6][4]);
+bool sphereInFrustum(const float planes[6][4], const float center[3], float radius);
+// Returns the index ranges of level to draw with model_matrix, none when the node's bounding
+// sphere is outside the view frustum. At full detail the clusters are culled against the view
+// frustum, neighbouring visible clusters are merged into one range. Both sides of the triangles
+// are drawn, so clusters facing away from the camera are kept.
+void visibleIndexRanges(const scenegraph::GeometryNode& geom_node, size_t level, const glm::mat4& model_matrix,
+		const Camera& camera, std::vector<scenegraph::IndexRange>& ranges);
+
+#endif //_MESH_CLUSTERS_H_
@@ -0,0 +1,53 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _MESH_OPTIMIZER_H_
+#define _MESH_OPTIMIZER_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "graphics/gl_code.h"
+#include "graphics/scene_graph.h"
+
+// Number of entries in the LRU cache modelled while ordering triangles
+#ifndef VERTEX_CACHE_OPTIMIZE_SIZE
+#define VERTEX_CACHE_OPTIMIZE_SIZE 32
+#endif
+
+// Number of entries in the FIFO cache used to report cache efficiency
+#ifndef VERTEX_CACHE_ANALYZE_SIZE
+#define VERTEX_CACHE_ANALYZE_SIZE 16
+#endif
+
+// Clusters may be split wherever their miss rate is within this factor of the whole mesh
+#ifndef OVERDRAW_CACHE_THRESHOLD
+#define OVERDRAW_CACHE_THRESHOLD 1.05f
+#endif
+
+// Post-transform cache misses of a triangle list, summed over any number of meshes
+typedef struct VertexCacheStatistics {
+	size_t triangles;
+	size_t vertices;
+	size_t misses;
+
+	VertexCacheStatistics();
+	void add(const VertexCacheStatistics& other);
+	// Average cache miss ratio, misses per triangle
+	float acmr() const;
+	// Average transform to vertex ratio, misses per vertex
+	float atvr() const;
+} VertexCacheStatistics;
+
+void analyzeVertexCache(const std::vector<GLuint>& indices, size_t vertex_count,
+		VertexCacheStatistics& statistics);
+// Reorders triangles for locality in the post-transform vertex cache, based on Tom Forsyth's
+// "Linear-Speed Vertex Cache Optimisation"
+void optimizeVertexCache(std::vector<GLuint>& indices, size_t vertex_count);
+// Splits cache optimized triangles into clusters and draws the clusters facing away from the
+// center first, so later clusters are more likely to be occluded (Sander et al., "Fast
+// Triangle Reordering for Vertex Locality and Reduced Overdraw")
+void optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<scenegraph::Vertex>& vertices);
+// Stores vertices in the order they are first referenced, dropping unreferenced vertices
+void optimizeVertexFetch(std::vector<GLuint>& indices, std::vector<scenegraph::Vertex>& vertices);
+
+#endif //_MESH_OPTIMIZER_H_
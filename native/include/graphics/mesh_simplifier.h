@@ -0,0 +1,38 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _MESH_SIMPLIFIER_H_
+#define _MESH_SIMPLIFIER_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "graphics/gl_code.h"
+#include "graphics/scene_graph.h"
+
+// Number of levels of detail including the full detail mesh
+#ifndef MESH_LOD_LEVELS
+#define MESH_LOD_LEVELS 4
+#endif
+
+// Each level aims for this fraction of the triangles of the previous level
+#ifndef MESH_LOD_REDUCTION
+#define MESH_LOD_REDUCTION 0.5f
+#endif
+
+// Levels that keep more than this fraction of the previous level's triangles are not stored
+#ifndef MESH_LOD_MIN_REDUCTION
+#define MESH_LOD_MIN_REDUCTION 0.85f
+#endif
+
+// Collapses edges of the triangle list using quadric error metrics until at most
+// target_index_count indices remain or no edge can be collapsed. Vertices are only moved onto
+// other existing vertices, so the result indexes the same vertex buffer. Open borders and
+// attribute seams are kept. Returns the square root of the largest area weighted quadric error of
+// a collapse, an estimate of the distance the surface moved in object units.
+float simplifyMesh(const std::vector<GLuint>& indices, const std::vector<scenegraph::Vertex>& vertices,
+		size_t target_index_count, std::vector<GLuint>& result);
+// Appends the levels of detail of a node built in index_data and vertex_data and records their ranges,
+// each submesh is simplified on its own and gets a submesh in every level it is not removed from
+void generateLods(scenegraph::GeometryNode* geom_node);
+
+#endif //_MESH_SIMPLIFIER_H_
@@ -0,0 +1,51 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _MODEL_REGISTRY_H_
+#define _MODEL_REGISTRY_H_
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "common/asset_manager.hpp"
+#include "common/thread_pool.hpp"
+#include "graphics/scene_arena.h"
+#include "graphics/scene_graph.h"
+
+// Loads each model file once and shares its geometry between every placement of it, so a file
+// referenced many times is parsed, stored and uploaded once. Every placement gets its own copy of
+// the nodes that hold transforms, so placements are moved independently.
+class ModelRegistry {
+public:
+	// Wavefront files are cached in cache_directory and parsed on the optional pool. The nodes are
+	// created in the optional arena, which then owns them instead of the registry.
+	ModelRegistry(const std::string& cache_directory, ThreadPool* pool, scenegraph::VertexFormat vertex_format,
+			scenegraph::SceneArena* arena = 0);
+	// Placements keep their geometry alive, since they hold references of their own. Without an
+	// arena they are destroyed first, their geometry refers to the materials of the models.
+	~ModelRegistry();
+	// Returns a new placement of the model owned by the caller, who releases it with
+	// scenegraph::destroy. The textures of the file are added to textures when it is loaded.
+	// Returns 0 when the file can not be loaded.
+	scenegraph::Node* acquireWavefront(const char* filename, AssetManager* asset_manager,
+			std::set<std::string>& textures);
+	scenegraph::Node* acquireGltf(const char* filename, AssetManager* asset_manager,
+			std::set<std::string>& textures);
+	// Destroys the models that are not placed anywhere, the memory of models in an arena is
+	// freed with the arena
+	void releaseUnused();
+	size_t size() const;
+private:
+	std::string cache_directory;
+	ThreadPool* pool;
+	scenegraph::VertexFormat vertex_format;
+	scenegraph::SceneArena* arena;
+	// The loaded models, which are copied for each placement and never placed themselves
+	std::map<std::string, scenegraph::Node*> models;
+
+	scenegraph::Node* find(const char* filename);
+	// Copies the nodes of model that have a transform below them and shares the others
+	scenegraph::Node* instantiate(scenegraph::Node* model);
+};
+
+#endif // _MODEL_REGISTRY_H_
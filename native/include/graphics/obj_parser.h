@@ -0,0 +1,91 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _OBJ_PARSER_H_
+#define _OBJ_PARSER_H_
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/thread_pool.hpp"
+
+// Files are split into chunks of at least this many bytes that are parsed in parallel
+#ifndef OBJ_PARSE_CHUNK_SIZE
+#define OBJ_PARSE_CHUNK_SIZE (1024 * 1024)
+#endif
+
+// Parses wavefront .obj and .mtl sources in place, the buffers do not need to be null-terminated
+namespace wavefront {
+
+// Zero based attribute indices, -1 when the attribute is not specified
+typedef struct Index {
+	int vertex_index;
+	int normal_index;
+	int texcoord_index;
+} Index;
+
+typedef struct Mesh {
+	// Triangle list, three indices per face
+	std::vector<Index> indices;
+	// One material per face, -1 when no material is used
+	std::vector<int> material_ids;
+} Mesh;
+
+typedef struct Shape {
+	std::string name;
+	Mesh mesh;
+} Shape;
+
+typedef struct Attrib {
+	std::vector<float> vertices;
+	std::vector<float> normals;
+	std::vector<float> texcoords;
+} Attrib;
+
+typedef struct Material {
+	std::string name;
+	float diffuse[3];
+	std::string diffuse_texname;
+} Material;
+
+// Result of parsing an .obj file, material ids refer to material_names until resolveMaterials is called
+typedef struct ObjData {
+	Attrib attrib;
+	std::vector<Shape> shapes;
+	std::vector<std::string> material_names;
+	std::vector<std::string> mtllibs;
+	// Faces dropped because they refer to attributes that were not parsed before the end of
+	// their chunk, set by the parse functions
+	size_t invalid_faces;
+} ObjData;
+
+// Returns the first '\n' in [begin, end) or end
+const char* findLineEnd(const char* begin, const char* end);
+// Parses a decimal floating point number at p and advances p past it
+float parseFloat(const char*& p, const char* end);
+
+// Large files are parsed in chunks on the pool, which must not be the pool running the caller
+bool parseObj(const char* data, size_t length, ObjData& obj, ThreadPool* pool = 0);
+// Called with each shape once all of its faces are parsed, the shape is freed when it returns.
+// Material ids of the shape refer to obj.material_names.
+typedef std::function<void(ObjData& obj, Shape& shape)> ShapeCallback;
+// Parses in rounds of up to one chunk per pool thread and frees every shape after emit_shape has
+// seen it, so only the attributes and the shapes of the current round are held at once
+bool parseObjStreaming(const char* data, size_t length, ObjData& obj, const ShapeCallback& emit_shape,
+		ThreadPool* pool = 0);
+// Collects the mtllib file names in file order without parsing anything else, so the material
+// files are known before deciding whether the .obj needs to be parsed
+void scanMtllibs(const char* data, size_t length, std::vector<std::string>& mtllibs);
+// Appends the materials defined in an .mtl source, material_map maps names to indices
+void parseMtl(const char* data, size_t length, std::vector<Material>& materials,
+		std::map<std::string, int>& material_map);
+// Converts per-face material name indices into indices of the parsed materials
+void resolveMaterials(ObjData& obj, const std::map<std::string, int>& material_map);
+void resolveMaterials(Shape& shape, const std::vector<std::string>& material_names,
+		const std::map<std::string, int>& material_map);
+
+} // namespace wavefront
+
+#endif //_OBJ_PARSER_H_
@@ -0,0 +1,112 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _SCENE_ARENA_H_
+#define _SCENE_ARENA_H_
+
+#include <cassert>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "graphics/scene_graph.h"
+
+// Number of nodes in each block of a pool
+#ifndef SCENE_ARENA_BLOCK_NODES
+#define SCENE_ARENA_BLOCK_NODES 256
+#endif
+
+namespace scenegraph {
+
+// Nodes of one type, constructed one after another in blocks that are never moved
+template<typename node_t>
+class NodePool {
+public:
+	NodePool() {
+		used = SCENE_ARENA_BLOCK_NODES;
+	}
+
+	~NodePool() {
+		release();
+	}
+
+	node_t* create() {
+		if (used == SCENE_ARENA_BLOCK_NODES) {
+			blocks.push_back((node_t*) ::operator new(sizeof(node_t) * SCENE_ARENA_BLOCK_NODES));
+			used = 0;
+		}
+		node_t* node = new (blocks.back() + used) node_t();
+		used++;
+		return node;
+	}
+
+	// Destroys the nodes in the order they were created and frees the blocks
+	void release() {
+		for (size_t b = 0; b < blocks.size(); b++) {
+			size_t count = b + 1 == blocks.size() ? used : SCENE_ARENA_BLOCK_NODES;
+			for (size_t i = 0; i < count; i++) {
+				blocks[b][i].~node_t();
+			}
+			::operator delete(blocks[b]);
+		}
+		blocks.clear();
+		used = SCENE_ARENA_BLOCK_NODES;
+	}
+
+	size_t size() const {
+		return blocks.empty() ? 0 : (blocks.size() - 1) * SCENE_ARENA_BLOCK_NODES + used;
+	}
+
+private:
+	std::vector<node_t*> blocks;
+	// Nodes constructed in the last block
+	size_t used;
+
+	NodePool(const NodePool&);
+	NodePool& operator=(const NodePool&);
+};
+
+// Allocates the nodes of a scene from a pool for each node type, so nodes of the same type are
+// next to each other in memory and the whole scene is freed by one release instead of a walk
+// of the graph. Nodes created here are marked pooled, scenegraph::destroy frees what they own
+// but leaves their slots to the arena.
+class SceneArena {
+public:
+	~SceneArena();
+	// Safe to call from several threads
+	template<typename node_t>
+	node_t* create() {
+		std::lock_guard<std::mutex> lock(mutex);
+		node_t* node = pool((node_t*) 0).create();
+		node->pooled = true;
+		return node;
+	}
+	// Destroys every node created by the arena, nothing may point to them afterwards
+	void release();
+	size_t size() const;
+private:
+	std::mutex mutex;
+	NodePool<Node> groups;
+	NodePool<GeometryNode> geometry;
+	NodePool<MaterialNode> materials;
+	NodePool<SwitchNode> switches;
+	NodePool<TransformNode> transforms;
+
+	NodePool<Node>& pool(Node*) { return groups; }
+	NodePool<GeometryNode>& pool(GeometryNode*) { return geometry; }
+	NodePool<MaterialNode>& pool(MaterialNode*) { return materials; }
+	NodePool<SwitchNode>& pool(SwitchNode*) { return switches; }
+	NodePool<TransformNode>& pool(TransformNode*) { return transforms; }
+};
+
+// Creates a node in arena, or with new when there is no arena
+template<typename node_t>
+node_t* createNode(SceneArena* arena) {
+	node_t* node = arena ? arena->create<node_t>() : new node_t();
+	assert(node);
+	return node;
+}
+
+} // namespace scenegraph
+
+#endif // _SCENE_ARENA_H_
@@ -11,6 +11,7 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <unordered_map>
 #include <cstdlib>
 
 #include <glm/vec2.hpp>
@@ -20,8 +21,16 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "common/string_interner.hpp"
 #include "graphics/gl_code.h"
 
+// Levels of detail are switched when their error would cover more pixels than this
+#ifndef MESH_LOD_PIXEL_ERROR
+#define MESH_LOD_PIXEL_ERROR 1.0f
+#endif
+
+class TransformStore;
+
 namespace scenegraph {
 
 typedef struct Vertex {
@@ -32,6 +41,49 @@ typedef struct Vertex {
 	bool operator==(const Vertex& other) const;
 } Vertex;
 
+// 16 byte vertex, positions are normalized shorts scaled by GeometryNode::position_scale,
+// normals are octahedral encoded and texcoords are half floats
+typedef struct PackedVertex {
+	// The fourth component pads the position to 8 bytes
+	GLshort position[4];
+	GLshort normal[2];
+	GLushort texcoord[2];
+} PackedVertex;
+
+// A range of index_data drawn at one level of detail. error estimates how far the simplified
+// surface is from the full detail surface in object units: the square root of the largest
+// area weighted quadric error of a collapse, summed over the levels. It is an average distance
+// to the planes of the removed triangles, not a bound on the largest distance.
+typedef struct LodLevel {
+	GLuint first_index;
+	GLuint index_count;
+	float error;
+} LodLevel;
+
+typedef struct IndexRange {
+	GLuint first_index;
+	GLuint index_count;
+} IndexRange;
+
+// A run of full detail triangles that is culled as a unit, the sphere bounds the triangles
+typedef struct MeshCluster {
+	GLuint first_index;
+	GLuint index_count;
+	float center[3];
+	float radius;
+} MeshCluster;
+
+// Triangles of one level of detail that share a material, material indexes GeometryNode::materials
+typedef struct SubMesh {
+	GLuint material;
+	GLuint first_index;
+	GLuint index_count;
+} SubMesh;
+
+typedef enum VertexFormat {
+	FloatVertexFormat, PackedVertexFormat,
+} VertexFormat;
+
 typedef enum NodeType {
 	Geometry, Group, Material, Switch, Transform,
 } NodeType;
@@ -43,20 +95,75 @@ public:
 	Node* find(const char* name);
 	Node* find(std::string& name, NodeType search_type);
 	Node* find(const char* name, NodeType search_type);
+	void setName(const std::string& new_name);
+	const std::string& getName() const;
 
-	std::string name;
+	// Interned by StringInterner::global()
+	NameId name;
 	size_t num_children;
 	NodeType type;
 	std::vector<Node*> children;
+	// Parents and owners sharing this node, it is deleted when the last one destroys it
+	size_t references;
+	// Allocated by a SceneArena, which deletes it when the arena is released
+	bool pooled;
 };
 
+class MaterialNode;
+
 class GeometryNode: public Node {
 public:
 	GeometryNode();
 	float center[3];
+	// Bounds of the vertex positions, which are relative to center
+	float aabb_min[3];
+	float aabb_max[3];
+	float sphere_center[3];
 	float radius;
+	// Vertices are built in vertex_data, packVertices moves them into packed_vertex_data
+	VertexFormat vertex_format;
 	std::vector<Vertex> vertex_data;
+	std::vector<PackedVertex> packed_vertex_data;
+	// Multiplies the decoded packed positions, which are relative to center
+	float position_scale;
+	// GL_UNSIGNED_INT while the mesh is built in index_data, compactIndices moves the
+	// indices into index_data_16 and switches to GL_UNSIGNED_SHORT when every vertex fits
+	GLenum index_type;
 	std::vector<GLuint> index_data;
+	std::vector<GLushort> index_data_16;
+	// Levels of detail from full detail down, every level indexes the same vertices
+	std::vector<LodLevel> lods;
+	// Clusters of the full detail level in index order, empty for small meshes
+	std::vector<MeshCluster> clusters;
+	// Material ranges of every level, in index order. Empty when the whole node is drawn with the
+	// material of the MaterialNode above it.
+	std::vector<SubMesh> submeshes;
+	// Materials of the submeshes, owned by the scene graph, 0 for triangles without a material
+	std::vector<MaterialNode*> materials;
+
+	void compactIndices();
+	size_t indexCount() const;
+	GLuint index(size_t i) const;
+	// Indices in the format given by index_type, for uploading to an element array buffer
+	const GLvoid* indexData() const;
+	size_t indexDataSize() const;
+	// Size in bytes of one index
+	size_t indexSize() const;
+	// A node without lods has one level spanning all of its indices
+	size_t lodCount() const;
+	LodLevel lod(size_t level) const;
+	// The coarsest level whose error projects to at most max_pixel_error pixels, drawn with model_matrix
+	size_t selectLod(const glm::mat4& model_matrix, const Camera& camera, float max_pixel_error) const;
+
+	void packVertices();
+	size_t vertexCount() const;
+	void getPosition(size_t i, float position[3]) const;
+	// Vertices in the format given by vertex_format, for uploading to an array buffer
+	const GLvoid* vertexData() const;
+	size_t vertexDataSize() const;
+	GLsizei vertexStride() const;
+	// Decodes the packed vertices for targets that cannot fetch them directly
+	void unpackVertices(std::vector<Vertex>& vertices) const;
 };
 
 class MaterialNode: public Node {
@@ -70,23 +177,80 @@ public:
 	bool enabled;
 };
 
+// Handle of a transform node that is not in a TransformStore
+#define TRANSFORM_NONE 0xFFFFFFFFu
+
 class TransformNode: public Node {
 public:
 	TransformNode();
+	// Local transform the node is built with, a TransformStore holds the current one once the
+	// node is added to it
 	glm::mat4 matrix;
+	// Index of the node's local matrix in the TransformStore
+	uint32_t transform;
 };
 
 Node* find(std::string& search, Node* root);
 Node* find(std::string& search, Node* root, NodeType type);
+Node* find(NameId search, Node* root);
+Node* find(NameId search, Node* root, NodeType type);
 
 TransformNode* find_transform_node(std::string& search, Node* root);
 TransformNode* find_transform_node(const char* search, Node* root);
 
+// Finds nodes by name without searching the graph. Nodes with the same name are kept in
+// depth first order, so the same node is found as by find. A node shared by several parents is
+// indexed once per parent.
+class NodeIndex {
+public:
+	NodeIndex();
+	// Indexes root and every node below it, replacing what was indexed before
+	void build(Node* root);
+	void clear();
+	// Adds child and the nodes below it to parent and to the index. Parent must be below the built
+	// root, the names found below child are indexed again in depth first order. The transforms
+	// built from the same root are rebuilt, or marked out of date when there is no root.
+	void addChild(Node* parent, Node* child, TransformStore& transforms);
+	// Removes child from parent and its nodes from the index, the caller destroys it.
+	// Returns false if child is not a child of parent.
+	bool removeChild(Node* parent, Node* child, TransformStore& transforms);
+	Node* find(NameId name) const;
+	Node* find(NameId name, NodeType type) const;
+	Node* find(const std::string& name) const;
+	Node* find(const std::string& name, NodeType type) const;
+	TransformNode* findTransform(NameId name) const;
+	TransformNode* findTransform(const std::string& name) const;
+	size_t size() const;
+private:
+	std::unordered_map<NameId, std::vector<Node*> > nodes;
+	size_t num_nodes;
+	Node* root;
+
+	void add(Node* node);
+	// Adds the nodes with one of names, in depth first order
+	void add(Node* node, const std::set<NameId>& names);
+	void remove(Node* node);
+	void collectNames(Node* node, std::set<NameId>& names);
+};
+
+// Frees the children list and buffers of a node created by a SceneArena and leaves an empty node
+// of the same type in its slot, the arena reclaims the slot when it is released
+void releasePooled(Node* node);
+
+// Adds a reference for another parent of node, each parent destroys it once
+template<typename node_t>
+node_t* share(node_t* node) {
+	node->references++;
+	return node;
+}
+
 template<typename node_t>
 void destroy(node_t* node) {
 	node_t* root = (node_t*) node;
 	if (root == 0)
 		return;
+	if (--root->references > 0)
+		return;
 	for (std::vector<Node*>::iterator it = root->children.begin();
 			it != root->children.end(); ++it) {
 		Node* child = *it;
@@ -112,8 +276,12 @@ void destroy(node_t* node) {
 			}
 		}
 	}
-	root->children.clear();
-	delete root;
+	if (root->pooled) {
+		releasePooled(root);
+	} else {
+		root->children.clear();
+		delete root;
+	}
 	root = 0;
 }
 
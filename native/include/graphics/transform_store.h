@@ -0,0 +1,86 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _TRANSFORM_STORE_H_
+#define _TRANSFORM_STORE_H_
+
+#include <vector>
+#include <stdint.h>
+
+#include <glm/mat4x4.hpp>
+
+#include "graphics/scene_graph.h"
+
+// A negative radius bounds nothing
+typedef struct BoundingSphere {
+	float center[3];
+	float radius;
+} BoundingSphere;
+
+// Local and world matrices of the transform nodes of a scene graph, kept in flat arrays instead
+// of on the nodes. Every transform node has one local matrix, reached through its handle, and
+// one world matrix for each place it occurs in the graph, since shared subtrees occur below
+// several parents. The occurrences are stored in depth first order, so a parent always comes
+// before its children and the subtree of an occurrence is the range of occurrences up to its end.
+// Changing a local matrix marks the subtrees of its occurrences, and only those are recomputed.
+class TransformStore {
+public:
+	TransformStore();
+	// Gives the transform nodes below root a handle and lays out their occurrences, replacing
+	// the previous layout. Handles are given out again on every build, so the handles of removed
+	// nodes are reused. Nodes that had a handle keep their local matrix, others start with
+	// TransformNode::matrix. Call it again whenever nodes are added or removed, or use the
+	// NodeIndex calls that do.
+	void build(scenegraph::Node* root);
+	// Marks the layout out of date until the next build, the local matrices stay valid
+	void invalidate();
+	// True when the occurrences match the graph they were built from
+	bool current() const;
+	// Recomputes the world matrices and bounds of the subtrees marked since the last update
+	void update();
+	void setLocal(uint32_t handle, const glm::mat4& matrix);
+	const glm::mat4& getLocal(uint32_t handle) const;
+	// Number of occurrences
+	size_t size() const;
+	// The node handle and world matrix of an occurrence, in the order a depth first walk of the
+	// graph visits them
+	uint32_t handle(size_t occurrence) const;
+	const glm::mat4& world(size_t occurrence) const;
+	// One past the last occurrence below occurrence
+	size_t subtreeEnd(size_t occurrence) const;
+	// World space sphere around the geometry below occurrence
+	const BoundingSphere& bounds(size_t occurrence) const;
+	// True when handle belongs to this store
+	bool contains(uint32_t handle) const;
+	// True when node has a handle in the current layout
+	bool contains(const scenegraph::TransformNode* node) const;
+private:
+	// Per node
+	std::vector<glm::mat4> local;
+	// The node each handle was given to, only compared to tell stale handles apart
+	std::vector<const scenegraph::TransformNode*> owners;
+	// Sphere around the geometry below the node and above its child transforms, in its space
+	std::vector<BoundingSphere> local_bounds;
+	// Occurrences of each node are occurrence_list[occurrence_offsets[handle]] up to the next offset
+	std::vector<uint32_t> occurrence_offsets;
+	std::vector<uint32_t> occurrence_list;
+
+	// Per occurrence, parents are -1 for occurrences without a transform above them
+	std::vector<uint32_t> handles;
+	std::vector<int32_t> parents;
+	std::vector<uint32_t> ends;
+	std::vector<glm::mat4> worlds;
+	std::vector<BoundingSphere> world_bounds;
+
+	// Occurrences whose local matrix changed since the last update
+	std::vector<uint32_t> dirty;
+	// Reused by update to avoid allocating
+	std::vector<int32_t> dirty_ancestors;
+	bool layout_current;
+
+	void add(scenegraph::Node* node, int32_t parent, const std::vector<glm::mat4>& previous_local,
+			const std::vector<const scenegraph::TransformNode*>& previous_owners);
+	void updateRange(size_t first, size_t end);
+	void updateBounds(size_t occurrence);
+};
+
+#endif // _TRANSFORM_STORE_H_
@@ -0,0 +1,18 @@
+// Copyright (C) 2017 Chris Liebert
+
+#ifndef _VERTEX_PACKING_H_
+#define _VERTEX_PACKING_H_
+
+#include "graphics/gl_code.h"
+
+// Conversions used by the packed vertex format
+GLushort floatToHalf(float value);
+float halfToFloat(GLushort value);
+// Octahedral encoding of a unit vector into two normalized shorts
+void octEncode(const float normal[3], GLshort encoded[2]);
+void octDecode(const GLshort encoded[2], float normal[3]);
+// Rounds v in [-1, 1] to a normalized short
+GLshort floatToSnorm16(float v);
+float snorm16ToFloat(GLshort v);
+
+#endif //_VERTEX_PACKING_H_
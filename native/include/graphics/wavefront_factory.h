@@ -26,8 +26,10 @@
 	#include <android/asset_manager_jni.h>
 #endif
 
+#include "graphics/mesh_cache.h"
+#include "graphics/obj_parser.h"
+#include "graphics/scene_arena.h"
 #include "graphics/scene_graph.h"
-#include "tiny_obj_loader.h"
 
 #ifdef _MSC_VER
 #define strncpy(A,B,C) strncpy_s(A,B,C)
@@ -35,6 +37,11 @@
 
 #define MAX_MATERIAL_NAME_LENGTH 128
 
+// Obj files of at least this many bytes are built one shape at a time while they are parsed
+#ifndef WAVEFRONT_STREAMING_THRESHOLD
+#define WAVEFRONT_STREAMING_THRESHOLD (256 * 1024 * 1024)
+#endif
+
 using std::cout;
 using std::cerr;
 using std::endl;
@@ -46,19 +53,35 @@ using namespace scenegraph;
 
 class WavefrontSceneGraphFactory {
 public:
-	WavefrontSceneGraphFactory();
+	// Processed meshes are cached in cache_directory, an empty string disables the cache.
+	// Large files are parsed in parallel on the optional pool. Nodes are created in the optional arena.
+	WavefrontSceneGraphFactory(const std::string& cache_directory = "", ThreadPool* pool = 0, SceneArena* arena = 0);
 	~WavefrontSceneGraphFactory();
 	void addTexture(const char*);
 	bool addWavefront(const char* wavefront_filename, glm::mat4, AssetManager* asset_manager);
 	Node* build();
 	std::set<std::string> wavefront_files;
 	std::set<std::string> textures;
+	// Layout of the vertices of meshes built after it is set
+	VertexFormat vertex_format;
+	// Files at least this large are built while they are parsed, which bounds the memory used for
+	// parsing to the vertex attributes and one shape, but bypasses the mesh cache
+	size_t streaming_threshold;
 private:
 	unsigned start_position;
 	std::string name;
 	std::vector<GeometryNode*> geometry_nodes;
 	std::vector<MaterialNode*> materials;
 	std::map<GeometryNode*, size_t> node_material_association;
+	MeshCache mesh_cache;
+	ThreadPool* pool;
+	SceneArena* arena;
+
+	bool addWavefrontStreaming(const char* wavefront_filename, AssetView& obj_view, AssetManager* asset_manager);
+	void addMaterials(std::vector<wavefront::Material>& material_list, size_t first);
+	void associateMaterial(GeometryNode* geom_node, size_t first_material);
+	void addCachedMesh(CachedMesh& mesh);
+	void saveCachedMesh(uint64_t key, size_t first_material, size_t first_geometry_node);
 };
 
 #endif //_WAVEFRONT_FACTORY_H_
@@ -4,6 +4,7 @@
 #define _SIMULATION_H_
 
 #include <cassert>
+#include <unordered_map>
 
 #include "rapidxml.hpp"
 #include "common/log.h"
@@ -34,15 +35,20 @@ protected:
 public:
 	btDiscreteDynamicsWorld* dynamics_world;
 	btAlignedObjectArray<btCollisionShape*> collision_shapes;
-	std::map<std::string, btBoxShape*> box_shapes;
-	std::map<std::string, btConvexHullShape*> convex_hull_shapes;
-	std::map<std::string, btRigidBody*> rigid_bodies;
+	// Keyed by the interned names of the transform nodes the bodies move
+	std::unordered_map<NameId, btBoxShape*> box_shapes;
+	std::unordered_map<NameId, btConvexHullShape*> convex_hull_shapes;
+	std::unordered_map<NameId, btRigidBody*> rigid_bodies;
 	std::map<int, PhysicsNode*> collision_node_index;
 
     Simulation();
 	~Simulation();
+	void applyForce(NameId rigid_body_name, const btVector3& force, const btVector3& rel_pos);
 	void applyForce(const std::string& rigid_body_name, const btVector3& force, const btVector3& rel_pos);
-	void parseXMLNode(rapidxml::xml_node<>* my_xml_node, scenegraph::Node* scene_node);
+	// Physics nodes are attached to the transform nodes of the same name in scene_index. Inside a
+	// model element the name is looked up in the placement that element made, from placements.
+	void parseXMLNode(rapidxml::xml_node<>* my_xml_node, const scenegraph::NodeIndex& scene_index,
+			const std::map<rapidxml::xml_node<>*, scenegraph::Node*>& placements, scenegraph::Node* placement = 0);
 	void step();
 };
 
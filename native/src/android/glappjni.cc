@@ -27,7 +27,7 @@ static GL3SceneGraphRenderer* gl3 = 0;
 
 extern "C" {
 
-JNIEXPORT void JNICALL Java_com_android_glappjni_GLAppJNILib_init(JNIEnv *env, jobject obj, jobject asset_mgr);
+JNIEXPORT void JNICALL Java_com_android_glappjni_GLAppJNILib_init(JNIEnv *env, jobject obj, jobject asset_mgr, jstring cache_dir, jint memory_class);
 JNIEXPORT void JNICALL Java_com_android_glappjni_GLAppJNILib_moveCamera(JNIEnv *env, jobject obj, jfloat x, jfloat y, jfloat z);
 JNIEXPORT void JNICALL Java_com_android_glappjni_GLAppJNILib_render(JNIEnv *env, jobject obj);
 JNIEXPORT void JNICALL Java_com_android_glappjni_GLAppJNILib_resize(JNIEnv *env, jobject obj, jint width, jint height);
@@ -44,7 +44,7 @@ JNIEXPORT void JNICALL Java_com_android_glappjni_GLAppJNILib_destroy(JNIEnv *env
 	#endif
 #endif
 
-JNIEXPORT void JNICALL Java_com_android_glappjni_GLAppJNILib_init(JNIEnv *env, jobject obj, jobject asset_mgr) {
+JNIEXPORT void JNICALL Java_com_android_glappjni_GLAppJNILib_init(JNIEnv *env, jobject obj, jobject asset_mgr, jstring cache_dir, jint memory_class) {
 	AAssetManager* asset_manager = AAssetManager_fromJava(env, asset_mgr);
 	assert(asset_manager);
 	if(gl2) {
@@ -59,7 +59,14 @@ JNIEXPORT void JNICALL Java_com_android_glappjni_GLAppJNILib_init(JNIEnv *env, j
         delete app;
         app = 0;
     }
-    app = new Application(asset_manager);
+    const char* cache_directory = env->GetStringUTFChars(cache_dir, 0);
+    // memory_class is the heap size of the app in megabytes, the default budget is used when it is unknown
+    size_t texture_budget = TEXTURE_STREAMING_BUDGET;
+    if (memory_class > 0) {
+        texture_budget = (size_t) memory_class * 1024 * 1024 / TEXTURE_STREAMING_MEMORY_CLASS_SHARE;
+    }
+    app = new Application(asset_manager, cache_directory, texture_budget);
+    env->ReleaseStringUTFChars(cache_dir, cache_directory);
     assert(app);
     const char *versionStr = (const char *) glGetString(GL_VERSION);
 	if (strstr(versionStr, "OpenGL ES 3.")) {
@@ -70,11 +77,11 @@ JNIEXPORT void JNICALL Java_com_android_glappjni_GLAppJNILib_init(JNIEnv *env, j
 		}
 #endif //DYNAMIC_ES3
 		LOGI("Creating OpenGL ES 3 Renderer");
-		gl3 = new GL3SceneGraphRenderer(app->images);
+		gl3 = new GL3SceneGraphRenderer();
 		assert(gl3);
 	} else if (strstr(versionStr, "OpenGL ES 2.")) {
 		LOGI("Creating OpenGL 2 Renderer");
-		gl2 = new GL2SceneGraphRenderer(app->images);
+		gl2 = new GL2SceneGraphRenderer();
 		assert(gl2);
 	} else {
 		LOGE("Unsupported OpenGL ES version");
@@ -118,10 +125,7 @@ JNIEXPORT void JNICALL Java_com_android_glappjni_GLAppJNILib_destroy(JNIEnv *env
 	}
 
     if(app) {
-        if(app->scenegraph_root) {
-            scenegraph::destroy(app->scenegraph_root);
-            app->scenegraph_root = 0;
-        }
+        // The application frees its scene graph with its arena
         delete app;
         app = 0;
     }
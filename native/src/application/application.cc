@@ -9,20 +9,43 @@
 #include "common/log.h"
 
 #define XML_FILENAME "data.xml"
+// Optional pack of all assets, created with the asset_packer tool
+#define ASSET_PACK_FILENAME "assets.pack"
+
+// Where processed meshes are cached between runs on the desktop, empty to disable the cache
+#ifndef MESH_CACHE_DIRECTORY
+#define MESH_CACHE_DIRECTORY "mesh_cache"
+#endif
+
+// Store meshes as 16 byte packed vertices instead of 32 byte float vertices
+#ifndef PACKED_VERTICES
+#define PACKED_VERTICES 1
+#endif
 
 Node* Application::loadResources() {
 	return loadXML(XML_FILENAME);
 }
 
 #if defined(__ANDROID__)
-Application::Application(AAssetManager* android_asset_manager) {
+Application::Application(AAssetManager* android_asset_manager, const char* cache_directory,
+		size_t texture_budget_bytes)
+: texture_budget(texture_budget_bytes), mesh_cache_directory(cache_directory) {
     this->asset_manager = new AssetManager(android_asset_manager);
 #elif defined(DESKTOP_APP)
-Application::Application() {
+Application::Application(size_t texture_budget_bytes)
+: texture_budget(texture_budget_bytes), mesh_cache_directory(MESH_CACHE_DIRECTORY) {
     this->asset_manager = new AssetManager();
 #endif
 	assert(this->asset_manager);
+	// Individual files are used when there is no pack
+	asset_manager->openPack(ASSET_PACK_FILENAME);
     config_file_contents = 0;
+    cancel_decoding = false;
+    worker_pool = new ThreadPool(ThreadPool::hardwareThreads());
+    assert(worker_pool);
+    model_registry = new ModelRegistry(mesh_cache_directory, worker_pool,
+    		PACKED_VERTICES ? PackedVertexFormat : FloatVertexFormat, &scene_arena);
+    assert(model_registry);
     simulation = new Simulation();
 	assert(simulation);
 	scenegraph_root = loadResources();
@@ -34,32 +57,42 @@ Application::Application() {
 }
 
 Application::~Application() {
+	// Skip decodes that have not started, then wait for the running ones
+	cancel_decoding = true;
+	texture_budget.cancel();
+	delete worker_pool;
+	worker_pool = 0;
+	std::pair<std::string, Image*> decoded;
+	while (decoded_images.tryPop(decoded)) {
+		delete decoded.second;
+	}
 	if (simulation) {
 		delete simulation;
 	}
-	if (scenegraph_root) {
-		scenegraph::destroy(scenegraph_root);
-		scenegraph_root = 0;
+	scene_index.clear();
+	scenegraph_root = 0;
+	if (model_registry) {
+		delete model_registry;
+		model_registry = 0;
 	}
-	for (std::map<std::string, Image*>::iterator it = images.begin();
-			it != images.end(); ++it) {
-		if (it->second) {
-			delete it->second;
-			it->second = 0;
-		}
-	}
-	images.clear();
+	// Frees the scene and the models at once instead of walking the graph
+	scene_arena.release();
 	if(asset_manager) {
 		delete asset_manager;
 	}
 }
 
 Node* Application::parseXML(rapidxml::xml_document<>& doc) {
-	Node* scene_node = new Node();
-	assert(scene_node);
-	scene_node->name = std::string(doc.name()) + std::string(" node");
+	Node* scene_node = createNode<Node>(&scene_arena);
+	scene_node->setName(std::string(doc.name()) + std::string(" node"));
+	// Start reading every referenced file before parsing any of them
+	prefetchXMLNode(doc.first_node());
+	placements.clear();
 	parseXMLNode(doc.first_node(), scene_node);
-	simulation->parseXMLNode(doc.first_node(), scene_node);
+	loadPendingTextures();
+	scene_index.build(scene_node);
+	transforms.build(scene_node);
+	simulation->parseXMLNode(doc.first_node(), scene_index, placements);
 	return scene_node;
 }
 
@@ -71,20 +104,30 @@ void Application::parseXMLNode(rapidxml::xml_node<>* my_xml_node,
 		for (rapidxml::xml_attribute<> *attr = my_xml_node->first_attribute();
 				attr; attr = attr->next_attribute()) {
 			if (0 == std::string("filename").compare(attr->name())) {
-				WavefrontSceneGraphFactory factory;
-				bool status = factory.addWavefront(attr->value(), glm::mat4(1.f), asset_manager);
-				assert(status);
-				for (std::set<std::string>::iterator it = factory.textures.begin(); it != factory.textures.end(); ++it) {
-					std::string s = *it;
-					if(images.find(s) == images.end()) {
-						Image* t = new Image(s.c_str(), asset_manager);
-						assert(t);
-						images.insert(std::make_pair(s, t));
-					}
+				std::set<std::string> textures;
+				Node* wf = model_registry->acquireWavefront(attr->value(), asset_manager, textures);
+				if (!wf) {
+					LOGE("Unable to load %s", attr->value());
+					continue;
 				}
-				Node* wf = factory.build();
-				assert(wf);
+				requestTextures(textures);
 				scene_node->children.push_back(wf);
+				placements[my_xml_node] = wf;
+			}
+		}
+	} else if (0 == std::string("GltfFile").compare(name)) {
+		for (rapidxml::xml_attribute<> *attr = my_xml_node->first_attribute();
+				attr; attr = attr->next_attribute()) {
+			if (0 == std::string("filename").compare(attr->name())) {
+				std::set<std::string> textures;
+				Node* gltf = model_registry->acquireGltf(attr->value(), asset_manager, textures);
+				if (!gltf) {
+					LOGE("Unable to load %s", attr->value());
+					continue;
+				}
+				requestTextures(textures);
+				scene_node->children.push_back(gltf);
+				placements[my_xml_node] = gltf;
 			}
 		}
 	} else if (0 == std::string("InstanceNode").compare(name)) {
@@ -96,8 +139,63 @@ void Application::parseXMLNode(rapidxml::xml_node<>* my_xml_node,
 	parseXMLNode(my_xml_node->next_sibling(), scene_node);
 }
 
+void Application::prefetchXMLNode(rapidxml::xml_node<>* my_xml_node) {
+	if (!my_xml_node) { return; }
+	if (0 == std::string("WavefrontFile").compare(my_xml_node->name())
+			|| 0 == std::string("GltfFile").compare(my_xml_node->name())) {
+		for (rapidxml::xml_attribute<> *attr = my_xml_node->first_attribute();
+				attr; attr = attr->next_attribute()) {
+			if (0 == std::string("filename").compare(attr->name())) {
+				asset_manager->loadAsync(attr->value());
+			}
+		}
+	}
+	prefetchXMLNode(my_xml_node->first_node());
+	prefetchXMLNode(my_xml_node->next_sibling());
+}
+
+// Textures are read in the background and decoded once the scene is parsed
+void Application::requestTextures(const std::set<std::string>& textures) {
+	for (std::set<std::string>::const_iterator it = textures.begin(); it != textures.end(); ++it) {
+		const std::string& s = *it;
+		if(requested_textures.find(s) == requested_textures.end()) {
+			asset_manager->loadAsync(s.c_str());
+			requested_textures.insert(s);
+			pending_textures.push_back(s);
+		}
+	}
+}
+
+void Application::loadPendingTextures() {
+	for (std::vector<std::string>::iterator it = pending_textures.begin(); it != pending_textures.end(); ++it) {
+		std::string texture_name = *it;
+		worker_pool->submit([this, texture_name]() {
+			if (cancel_decoding) {
+				return;
+			}
+			// Blocks while too many decoded images are waiting for the renderer
+			Image* t = new Image(texture_name.c_str(), asset_manager, &texture_budget);
+			assert(t);
+			if (cancel_decoding) {
+				delete t;
+				return;
+			}
+			decoded_images.push(std::make_pair(texture_name, t));
+		});
+	}
+	pending_textures.clear();
+}
+
 Node* Application::loadXML(const char* xml_filename) {
 	rapidxml::xml_document<> doc;
+	// rapidxml parses in place, a copy-on-write mapping only copies the pages it modifies
+	AssetView xml_view;
+	if (asset_manager->mapAsset(xml_filename, xml_view, true)
+			&& xml_view.mutableChars() && xml_view.isNullTerminated()) {
+		doc.parse<0>(xml_view.mutableChars());
+		return parseXML(doc);
+	}
+	// Fall back to copying the file when the view is read-only or not terminated
     config_file_contents = asset_manager->loadTextChars(xml_filename);
     if(config_file_contents == 0) {
     	return 0;
@@ -119,6 +217,8 @@ void Application::resize(int width, int height) {
 	assert(camera);
 	camera->projection_matrix = glm::perspective(45.0f,
 			(float) ((double) width / (double) height), 0.1f, 10000.0f);
+	camera->viewport_width = width;
+	camera->viewport_height = height;
 	camera->update();
 }
 
@@ -131,6 +231,10 @@ void Application::step() {
 	btCollisionObjectArray& collision_object_array = simulation->dynamics_world->getCollisionObjectArray();
 	for (int j = simulation->dynamics_world->getNumCollisionObjects() - 1; j >= 0; j--) {
 		btCollisionObject* obj = collision_object_array[j];
+		// Sleeping bodies have not moved, so their transforms are left clean
+		if (!obj->isActive()) {
+			continue;
+		}
 		btRigidBody* body = btRigidBody::upcast(obj);
 		btTransform trans;
 		if (body && body->getMotionState()) {
@@ -140,14 +244,17 @@ void Application::step() {
 		}
 
 		std::map<int, PhysicsNode*>::iterator itr = simulation->collision_node_index.find(j);
-		if (itr != simulation->collision_node_index.end() && itr->second->mass > 0.f) {
+		// Bodies whose node was removed from the scene have nothing to move
+		if (itr != simulation->collision_node_index.end() && itr->second->mass > 0.f
+				&& transforms.contains(itr->second->transform_node)) {
 			btVector3 origin_bt = trans.getOrigin();
 			glm::vec3 pos((float) origin_bt.x(), (float) origin_bt.y(), (float) origin_bt.z());
 			glm::mat4 pos_mat = glm::translate(glm::mat4(1.0f), pos);
 			btQuaternion rotation_bt = trans.getRotation();
 			glm::quat quat(rotation_bt.w(), rotation_bt.x(), rotation_bt.y(), rotation_bt.z());
 			glm::mat4 rotation = glm::toMat4(quat);
-			itr->second->transform_node->matrix = pos_mat * rotation;
+			transforms.setLocal(itr->second->transform_node->transform, pos_mat * rotation);
 		}
 	}
+	transforms.update();
 }
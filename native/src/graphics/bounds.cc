@@ -0,0 +1,164 @@
+// Copyright (C) 2017 Chris Liebert
+
+#include <cmath>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BOUNDS_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BOUNDS_NEON 1
+#endif
+
+#include "graphics/bounds.h"
+
+using scenegraph::GeometryNode;
+using scenegraph::Vertex;
+
+static inline float distanceSquared(const float* a, const float* b) {
+	float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+	return dx * dx + dy * dy + dz * dz;
+}
+
+// Box of the positions and the index of the vertex at each side of it. Each position is loaded
+// as four floats, the fourth lane is the first normal component and is ignored.
+static void findExtremes(const std::vector<Vertex>& vertices, float min[3], float max[3],
+		uint32_t min_index[3], uint32_t max_index[3]) {
+	size_t count = vertices.size();
+#if defined(BOUNDS_SSE2)
+	__m128 min_v = _mm_loadu_ps(vertices[0].position);
+	__m128 max_v = min_v;
+	__m128i min_i = _mm_setzero_si128();
+	__m128i max_i = _mm_setzero_si128();
+	for (size_t i = 1; i < count; i++) {
+		__m128 p = _mm_loadu_ps(vertices[i].position);
+		__m128i index = _mm_set1_epi32((int) i);
+		__m128i below = _mm_castps_si128(_mm_cmplt_ps(p, min_v));
+		__m128i above = _mm_castps_si128(_mm_cmpgt_ps(p, max_v));
+		min_v = _mm_min_ps(min_v, p);
+		max_v = _mm_max_ps(max_v, p);
+		min_i = _mm_or_si128(_mm_and_si128(below, index), _mm_andnot_si128(below, min_i));
+		max_i = _mm_or_si128(_mm_and_si128(above, index), _mm_andnot_si128(above, max_i));
+	}
+	float min_lanes[4], max_lanes[4];
+	uint32_t min_index_lanes[4], max_index_lanes[4];
+	_mm_storeu_ps(min_lanes, min_v);
+	_mm_storeu_ps(max_lanes, max_v);
+	_mm_storeu_si128((__m128i*) min_index_lanes, min_i);
+	_mm_storeu_si128((__m128i*) max_index_lanes, max_i);
+#elif defined(BOUNDS_NEON)
+	float32x4_t min_v = vld1q_f32(vertices[0].position);
+	float32x4_t max_v = min_v;
+	uint32x4_t min_i = vdupq_n_u32(0);
+	uint32x4_t max_i = vdupq_n_u32(0);
+	for (size_t i = 1; i < count; i++) {
+		float32x4_t p = vld1q_f32(vertices[i].position);
+		uint32x4_t index = vdupq_n_u32((uint32_t) i);
+		uint32x4_t below = vcltq_f32(p, min_v);
+		uint32x4_t above = vcgtq_f32(p, max_v);
+		min_v = vminq_f32(min_v, p);
+		max_v = vmaxq_f32(max_v, p);
+		min_i = vbslq_u32(below, index, min_i);
+		max_i = vbslq_u32(above, index, max_i);
+	}
+	float min_lanes[4], max_lanes[4];
+	uint32_t min_index_lanes[4], max_index_lanes[4];
+	vst1q_f32(min_lanes, min_v);
+	vst1q_f32(max_lanes, max_v);
+	vst1q_u32(min_index_lanes, min_i);
+	vst1q_u32(max_index_lanes, max_i);
+#else
+	float min_lanes[3], max_lanes[3];
+	uint32_t min_index_lanes[3] = { 0, 0, 0 }, max_index_lanes[3] = { 0, 0, 0 };
+	for (int k = 0; k < 3; k++) {
+		min_lanes[k] = max_lanes[k] = vertices[0].position[k];
+	}
+	for (size_t i = 1; i < count; i++) {
+		for (int k = 0; k < 3; k++) {
+			float v = vertices[i].position[k];
+			if (v < min_lanes[k]) {
+				min_lanes[k] = v;
+				min_index_lanes[k] = (uint32_t) i;
+			}
+			if (v > max_lanes[k]) {
+				max_lanes[k] = v;
+				max_index_lanes[k] = (uint32_t) i;
+			}
+		}
+	}
+#endif
+	for (int k = 0; k < 3; k++) {
+		min[k] = min_lanes[k];
+		max[k] = max_lanes[k];
+		min_index[k] = min_index_lanes[k];
+		max_index[k] = max_index_lanes[k];
+	}
+}
+
+void computeBounds(GeometryNode* geom_node) {
+	const std::vector<Vertex>& vertices = geom_node->vertex_data;
+	if (vertices.empty()) {
+		for (int k = 0; k < 3; k++) {
+			geom_node->aabb_min[k] = geom_node->aabb_max[k] = geom_node->sphere_center[k] = 0.f;
+		}
+		geom_node->radius = 0.f;
+		return;
+	}
+	uint32_t min_index[3], max_index[3];
+	findExtremes(vertices, geom_node->aabb_min, geom_node->aabb_max, min_index, max_index);
+
+	// Start from the pair of extremes that is farthest apart
+	int widest_axis = 0;
+	float widest_squared = -1.f;
+	for (int k = 0; k < 3; k++) {
+		float d2 = distanceSquared(vertices[min_index[k]].position, vertices[max_index[k]].position);
+		if (d2 > widest_squared) {
+			widest_squared = d2;
+			widest_axis = k;
+		}
+	}
+	const float* a = vertices[min_index[widest_axis]].position;
+	const float* b = vertices[max_index[widest_axis]].position;
+	float center[3];
+	for (int k = 0; k < 3; k++) {
+		center[k] = 0.5f * (a[k] + b[k]);
+	}
+	float radius = 0.5f * sqrtf(widest_squared);
+
+	float box_center[3];
+	for (int k = 0; k < 3; k++) {
+		box_center[k] = 0.5f * (geom_node->aabb_min[k] + geom_node->aabb_max[k]);
+	}
+	float box_radius_squared = 0.f;
+	for (size_t i = 0; i < vertices.size(); i++) {
+		const float* p = vertices[i].position;
+		float d2 = distanceSquared(p, center);
+		if (d2 > radius * radius) {
+			// Grow the sphere just enough to touch p, keeping the far side in place
+			float d = sqrtf(d2);
+			float grown = 0.5f * (radius + d);
+			float shift = (grown - radius) / d;
+			for (int k = 0; k < 3; k++) {
+				center[k] += (p[k] - center[k]) * shift;
+			}
+			radius = grown;
+		}
+		float box_d2 = distanceSquared(p, box_center);
+		if (box_d2 > box_radius_squared) {
+			box_radius_squared = box_d2;
+		}
+	}
+	float box_radius = sqrtf(box_radius_squared);
+	if (box_radius < radius) {
+		radius = box_radius;
+		for (int k = 0; k < 3; k++) {
+			center[k] = box_center[k];
+		}
+	}
+	for (int k = 0; k < 3; k++) {
+		geom_node->sphere_center[k] = center[k];
+	}
+	// Rounding while growing may leave the last points just outside
+	geom_node->radius = radius * 1.0001f;
+}
@@ -6,6 +6,8 @@ Camera::Camera() {
 	projection_matrix = glm::mat4(1.0);
 	horizontal_angle = M_PI; //3.1415926539
 	vertical_angle = 0.0;
+	viewport_width = 0;
+	viewport_height = 0;
 	position = glm::vec3(0.0, 0.0, 0.0);
 	aim(0.0, 0.0);
 	update();
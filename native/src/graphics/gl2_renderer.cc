@@ -1,9 +1,35 @@
 // Copyright (C) 2017 Chris Liebert
 
+#include <algorithm>
+#include <cstring>
+
 #include "graphics/gl_code.h"
+#include "graphics/mesh_clusters.h"
 #include "graphics/scene_graph.h"
+#include "graphics/transform_store.h"
 #include "graphics/gl2_renderer.h"
 
+#ifndef GL_HALF_FLOAT_OES
+#define GL_HALF_FLOAT_OES 0x8D61
+#endif
+
+// OpenGL ES 2 only fetches half floats with GL_OES_vertex_half_float, which uses its own enum
+static GLenum halfFloatAttributeType() {
+#if defined(__ANDROID__)
+	const char* version = (const char*) glGetString(GL_VERSION);
+	if (version && strncmp(version, "OpenGL ES ", 10) == 0 && version[10] >= '3') {
+		return GL_HALF_FLOAT;
+	}
+	const char* extensions = (const char*) glGetString(GL_EXTENSIONS);
+	if (extensions && strstr(extensions, "GL_OES_vertex_half_float")) {
+		return GL_HALF_FLOAT_OES;
+	}
+	return 0;
+#else
+	return GLAD_GL_VERSION_3_0 ? GL_HALF_FLOAT : 0;
+#endif
+}
+
 void GL2SceneGraphRenderer::walk_init_buffers(Node* node) {
 	if(node == 0) return;
 	if(node->type == NodeType::Geometry) {
@@ -13,16 +39,23 @@ void GL2SceneGraphRenderer::walk_init_buffers(Node* node) {
 			GLuint vbo;
 			glGenBuffers(1, &vbo);
 			glBindBuffer(GL_ARRAY_BUFFER, vbo);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * geometry_node->vertex_data.size(),
-					geometry_node->vertex_data.data(), GL_STATIC_DRAW);
+			if(geometry_node->vertex_format == PackedVertexFormat && half_float_type == 0) {
+				std::vector<Vertex> vertices;
+				geometry_node->unpackVertices(vertices);
+				glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+				unpacked_nodes.insert(geometry_node);
+			} else {
+				glBufferData(GL_ARRAY_BUFFER, geometry_node->vertexDataSize(),
+						geometry_node->vertexData(), GL_STATIC_DRAW);
+			}
 			glBindBuffer(GL_ARRAY_BUFFER, 0);
 			vbos.insert(std::make_pair(geometry_node, vbo));
 
 			GLuint ibo;
 			glGenBuffers(1, &ibo);
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * geometry_node->index_data.size(),
-					geometry_node->index_data.data(), GL_STATIC_DRAW);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, geometry_node->indexDataSize(),
+					geometry_node->indexData(), GL_STATIC_DRAW);
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 			ibos.insert(std::make_pair(geometry_node, ibo));
@@ -34,8 +67,37 @@ void GL2SceneGraphRenderer::walk_init_buffers(Node* node) {
 	}
 }
 
-void GL2SceneGraphRenderer::walk_render(Node* node) {
+void GL2SceneGraphRenderer::bindMaterial(MaterialNode* material_node) {
+	std::map<std::string, GLuint>::iterator texture_id_itr = texture_ids.end();
+	if(material_node) {
+		texture_id_itr = texture_ids.find(material_node->diffuse_texture);
+	}
+	if(texture_id_itr == texture_ids.end()) {
+		// The texture may still be decoding
+		glBindTexture(GL_TEXTURE_2D, 0);
+	} else {
+		glUniform1ui(glGetUniformLocation(shader_program, "diffuseTexture"), 0);
+		GLuint texture_id = texture_id_itr->second;
+		glBindTexture(GL_TEXTURE_2D, texture_id);
+	}
+}
+
+// Draws the parts of draw_ranges between the indices first and end
+void GL2SceneGraphRenderer::drawRanges(GeometryNode* geometry_node, GLuint first, GLuint end) {
+	for(std::vector<IndexRange>::iterator range = draw_ranges.begin(); range != draw_ranges.end(); ++range) {
+		GLuint range_first = std::max(first, range->first_index);
+		GLuint range_end = std::min(end, range->first_index + range->index_count);
+		if(range_first < range_end) {
+			glDrawElements(GL_TRIANGLES, (GLsizei) (range_end - range_first), geometry_node->index_type,
+					BUFFER_OFFSET(range_first * geometry_node->indexSize()));
+		}
+	}
+}
+
+void GL2SceneGraphRenderer::walk_render(Node* node, Camera* camera) {
 	if(node == 0) return;
+	// Transforms nest, the matrix is restored once the children are drawn
+	glm::mat4 parent_matrix = model_matrix;
 	if(node->type == NodeType::Geometry) {
 		GeometryNode* geometry_node = (GeometryNode*) node;
 		assert(geometry_node);
@@ -45,12 +107,40 @@ void GL2SceneGraphRenderer::walk_render(Node* node) {
 			glBindBuffer(GL_ARRAY_BUFFER, vbo);
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
 			glEnableVertexAttribArray(0);
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), BUFFER_OFFSET(0));
 			glEnableVertexAttribArray(1);
-			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),	BUFFER_OFFSET(3 * sizeof(float)));
 			glEnableVertexAttribArray(2);
-			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),	BUFFER_OFFSET(6 * sizeof(float)));
-			glDrawElements(GL_TRIANGLES, (GLsizei)(sizeof(GLuint) * geometry_node->index_data.size()), GL_UNSIGNED_INT, BUFFER_OFFSET(0));
+			if(geometry_node->vertex_format == PackedVertexFormat && unpacked_nodes.count(geometry_node) == 0) {
+				GLsizei stride = sizeof(PackedVertex);
+				glUniform1f(position_scale_uniform_location, geometry_node->position_scale);
+				glUniform1f(packed_normal_uniform_location, 1.0f);
+				glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, stride, BUFFER_OFFSET(offsetof(PackedVertex, position)));
+				glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, BUFFER_OFFSET(offsetof(PackedVertex, normal)));
+				glVertexAttribPointer(2, 2, half_float_type, GL_FALSE, stride, BUFFER_OFFSET(offsetof(PackedVertex, texcoord)));
+			} else {
+				glUniform1f(position_scale_uniform_location, 1.0f);
+				glUniform1f(packed_normal_uniform_location, 0.0f);
+				glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), BUFFER_OFFSET(0));
+				glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),	BUFFER_OFFSET(3 * sizeof(float)));
+				glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),	BUFFER_OFFSET(6 * sizeof(float)));
+			}
+			glUniformMatrix4fv(matrix_uniform_location, 1, GL_FALSE, glm::value_ptr(model_matrix));
+			size_t level = geometry_node->selectLod(model_matrix, *camera, MESH_LOD_PIXEL_ERROR);
+			visibleIndexRanges(*geometry_node, level, model_matrix, *camera, draw_ranges);
+			if(geometry_node->submeshes.empty()) {
+				drawRanges(geometry_node, 0, (GLuint) geometry_node->indexCount());
+			} else {
+				// Every submesh of the level is drawn from the bound buffers with its own texture
+				LodLevel lod = geometry_node->lod(level);
+				for(std::vector<SubMesh>::iterator submesh = geometry_node->submeshes.begin();
+						submesh != geometry_node->submeshes.end(); ++submesh) {
+					if(submesh->first_index < lod.first_index
+							|| submesh->first_index >= lod.first_index + lod.index_count) {
+						continue;
+					}
+					bindMaterial(geometry_node->materials[submesh->material]);
+					drawRanges(geometry_node, submesh->first_index, submesh->first_index + submesh->index_count);
+				}
+			}
 			glDisableVertexAttribArray(2);
 			glDisableVertexAttribArray(1);
 			glDisableVertexAttribArray(0);
@@ -60,34 +150,38 @@ void GL2SceneGraphRenderer::walk_render(Node* node) {
 	} else if(node->type == NodeType::Material) {
 		MaterialNode* material_node = (MaterialNode*) node;
 		assert(material_node);
-		std::map<std::string, GLuint>::iterator texture_id_itr = texture_ids.find(material_node->diffuse_texture);
-		if(texture_id_itr == texture_ids.end()) {
-			LOGI("Unable to use texture %s", material_node->diffuse_texture.c_str());
-		} else {
-			glUniform1ui(glGetUniformLocation(shader_program, "diffuseTexture"), 0);
-			GLuint texture_id = texture_id_itr->second;
-			glBindTexture(GL_TEXTURE_2D, texture_id);
-		}
+		bindMaterial(material_node);
 	} else if(node->type == NodeType::Transform) {
 		TransformNode* tn = (TransformNode*) node;
-		glUniformMatrix4fv(matrix_uniform_location, 1, GL_FALSE, glm::value_ptr(tn->matrix));
+		// A current store lists the transforms in the order they are visited here. Otherwise the
+		// matrix is composed from the local ones, and transforms added since the store was built
+		// are not drawn until it is rebuilt.
+		if (transforms->current()) {
+			assert(next_transform < transforms->size() && transforms->handle(next_transform) == tn->transform);
+			// Nothing below a transform whose bounds are out of view is drawn
+			const BoundingSphere& bounds = transforms->bounds(next_transform);
+			if (bounds.radius < 0.f || !sphereInFrustum(view_planes, bounds.center, bounds.radius)) {
+				next_transform = transforms->subtreeEnd(next_transform);
+				model_matrix = parent_matrix;
+				return;
+			}
+			model_matrix = transforms->world(next_transform);
+			next_transform++;
+		} else if (transforms->contains(tn)) {
+			model_matrix = parent_matrix * transforms->getLocal(tn->transform);
+		} else {
+			model_matrix = parent_matrix;
+			return;
+		}
 	}
 	for(std::vector<Node*>::iterator it = node->children.begin(); it!=node->children.end(); ++it) {
 		Node* child = *it;
-		walk_render(child);
+		walk_render(child, camera);
 	}
+	model_matrix = parent_matrix;
 }
 
-GL2SceneGraphRenderer::GL2SceneGraphRenderer(std::map<std::string, Image*>& images) {
-	for(std::map<std::string, Image*>::iterator it = images.begin(); it != images.end(); ++it) {
-		if(texture_ids.find(it->first) == texture_ids.end()) {
-			texture_ids.insert(std::make_pair(it->first, it->second->loadTexture()));
-			delete it->second;
-			it->second = 0;
-		}
-	}
-	images.clear();
-
+GL2SceneGraphRenderer::GL2SceneGraphRenderer() {
 	const char* vertex_shader_src =
 		"#version 100																		\n"
 		"attribute highp vec3 vPosition;					        			        	\n"
@@ -96,6 +190,8 @@ GL2SceneGraphRenderer::GL2SceneGraphRenderer(std::map<std::string, Image*>& imag
 		"uniform highp mat4 projection;                										\n"
 		"uniform highp mat4 modelview;                  									\n"
 		"uniform highp mat4 matrix;               											\n"
+		"uniform highp float positionScale;													\n"
+		"uniform highp float packedNormal;													\n"
 		"varying highp vec3 fragPos;														\n"
 		"varying highp vec3 normal;															\n"
 		"varying highp vec2 texcoord;														\n"
@@ -150,11 +246,20 @@ GL2SceneGraphRenderer::GL2SceneGraphRenderer(std::map<std::string, Image*>& imag
 		"                 );																\n"
 		"    return outMatrix;																\n"
 		"}																					\n"
+		"highp vec3 octDecode(highp vec2 e) {												\n"
+		"	highp vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));								\n"
+		"	highp float t = max(-n.z, 0.0);													\n"
+		"	n.x += n.x >= 0.0 ? -t : t;														\n"
+		"	n.y += n.y >= 0.0 ? -t : t;														\n"
+		"	return normalize(n);															\n"
+		"}																					\n"
 		"void main() {																		\n"
+		"	highp vec4 position = vec4(vPosition * positionScale, 1.0);						\n"
+		"	highp vec3 vertexNormal = packedNormal > 0.5 ? octDecode(vNormal.xy) : vNormal;	\n"
 		"	gl_Position = projection * modelview											\n"
-		"		* matrix * vec4(vPosition, 1.0);											\n"
-		"	fragPos = vec3(modelview * matrix * vec4(vPosition, 1.0));						\n"
-		"	normal = mat3(mat4_transpose(mat4_inverse(modelview * matrix))) * vNormal;		\n"
+		"		* matrix * position;														\n"
+		"	fragPos = vec3(modelview * matrix * position);									\n"
+		"	normal = mat3(mat4_transpose(mat4_inverse(modelview * matrix))) * vertexNormal;	\n"
 		"	highp vec3 lightPosIn = vec3(0.0, 10.0, 0.0);									\n"
 		"	lightPos = vec3(modelview * vec4(lightPosIn, 1.0));								\n"
 		"	texcoord = vTexCoord;															\n"
@@ -193,6 +298,12 @@ GL2SceneGraphRenderer::GL2SceneGraphRenderer(std::map<std::string, Image*>& imag
 	glUseProgram(shader_program);
 	glActiveTexture(GL_TEXTURE0);
 	matrix_uniform_location = glGetUniformLocation(shader_program, "matrix");
+	position_scale_uniform_location = glGetUniformLocation(shader_program, "positionScale");
+	packed_normal_uniform_location = glGetUniformLocation(shader_program, "packedNormal");
+	half_float_type = halfFloatAttributeType();
+	if(half_float_type == 0) {
+		LOGI("Half float vertex attributes are not supported, packed vertices will be unpacked\n");
+	}
 }
 
 GL2SceneGraphRenderer::~GL2SceneGraphRenderer() {
@@ -210,10 +321,11 @@ GL2SceneGraphRenderer::~GL2SceneGraphRenderer() {
 	}
 	vbos.clear();
 	ibos.clear();
+	unpacked_nodes.clear();
 	glDeleteProgram(shader_program);
 }
 
-void GL2SceneGraphRenderer::render(Node* node, Camera* camera) {
+void GL2SceneGraphRenderer::render(Node* node, const TransformStore& transform_store, Camera* camera) {
 	glEnable(GL_DEPTH_TEST);
 	walk_init_buffers(node);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -224,6 +336,24 @@ void GL2SceneGraphRenderer::render(Node* node, Camera* camera) {
 	glUniformMatrix4fv(modelview_location, 1, GL_FALSE, glm::value_ptr(camera->modelview_matrix));
 	glUniform3f(glGetUniformLocation(shader_program, "lightPos"), 0.0f, 10.0f, -10.0f);
 	glUniform1ui(glGetUniformLocation(shader_program, "diffuseTexture"), 0);
-	walk_render(node);
+	model_matrix = glm::mat4(1.f);
+	transforms = &transform_store;
+	next_transform = 0;
+	extractFrustumPlanes(camera->projection_matrix * camera->modelview_matrix, view_planes);
+	walk_render(node, camera);
 	glUseProgram(0);
 }
+
+// Upload the images that have finished decoding since the last call, then free them
+void GL2SceneGraphRenderer::uploadTextures(DecodedImageQueue& decoded_images) {
+	std::pair<std::string, Image*> decoded;
+	while (decoded_images.tryPop(decoded)) {
+		if (texture_ids.find(decoded.first) == texture_ids.end()) {
+			if (!decoded.second->data) {
+				LOGE("Unable to use texture %s", decoded.first.c_str());
+			}
+			texture_ids.insert(std::make_pair(decoded.first, decoded.second->loadTexture()));
+		}
+		delete decoded.second;
+	}
+}
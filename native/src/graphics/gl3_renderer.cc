@@ -1,7 +1,11 @@
 // Copyright (C) 2017 Chris Liebert
 
+#include <algorithm>
+
 #include "graphics/gl_code.h"
+#include "graphics/mesh_clusters.h"
 #include "graphics/scene_graph.h"
+#include "graphics/transform_store.h"
 #include "graphics/gl3_renderer.h"
 
 void GL3SceneGraphRenderer::walk_init_buffers(Node* node) {
@@ -13,9 +17,8 @@ void GL3SceneGraphRenderer::walk_init_buffers(Node* node) {
 			GLuint vao, vbo, ibo;
 			glGenBuffers(1, &vbo);
 			glBindBuffer(GL_ARRAY_BUFFER, vbo);
-			glBufferData(GL_ARRAY_BUFFER,
-					sizeof(Vertex) * geometry_node->vertex_data.size(),
-					geometry_node->vertex_data.data(), GL_STATIC_DRAW);
+			glBufferData(GL_ARRAY_BUFFER, geometry_node->vertexDataSize(),
+					geometry_node->vertexData(), GL_STATIC_DRAW);
 			glGenVertexArrays(1, &vao);
 			glBindVertexArray(vao);
 			vaos.insert(std::make_pair(geometry_node, vao));
@@ -24,8 +27,8 @@ void GL3SceneGraphRenderer::walk_init_buffers(Node* node) {
 
 			glGenBuffers(1, &ibo);
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * geometry_node->index_data.size(),
-					geometry_node->index_data.data(), GL_STATIC_DRAW);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, geometry_node->indexDataSize(),
+					geometry_node->indexData(), GL_STATIC_DRAW);
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 			ibos.insert(std::make_pair(geometry_node, ibo));
 		}
@@ -37,9 +40,37 @@ void GL3SceneGraphRenderer::walk_init_buffers(Node* node) {
 	}
 }
 
-void GL3SceneGraphRenderer::walk_render(Node* node) {
+void GL3SceneGraphRenderer::bindMaterial(MaterialNode* material_node) {
+	std::map<std::string, GLuint>::iterator texture_id_itr = texture_ids.end();
+	if (material_node) {
+		texture_id_itr = texture_ids.find(material_node->diffuse_texture);
+	}
+	if (texture_id_itr == texture_ids.end()) {
+		// The texture may still be decoding
+		glBindTexture(GL_TEXTURE_2D, 0);
+	} else {
+		GLuint texture_id = texture_id_itr->second;
+		glBindTexture(GL_TEXTURE_2D, texture_id);
+	}
+}
+
+// Draws the parts of draw_ranges between the indices first and end
+void GL3SceneGraphRenderer::drawRanges(GeometryNode* geometry_node, GLuint first, GLuint end) {
+	for (std::vector<IndexRange>::iterator range = draw_ranges.begin(); range != draw_ranges.end(); ++range) {
+		GLuint range_first = std::max(first, range->first_index);
+		GLuint range_end = std::min(end, range->first_index + range->index_count);
+		if (range_first < range_end) {
+			glDrawElements(GL_TRIANGLES, (GLsizei) (range_end - range_first), geometry_node->index_type,
+					BUFFER_OFFSET(range_first * geometry_node->indexSize()));
+		}
+	}
+}
+
+void GL3SceneGraphRenderer::walk_render(Node* node, Camera* camera) {
 	if (node == 0)
 		return;
+	// Transforms nest, the matrix is restored once the children are drawn
+	glm::mat4 parent_matrix = model_matrix;
 	if (node->type == NodeType::Geometry) {
 		GeometryNode* geometry_node = (GeometryNode*) node;
 		assert(geometry_node);
@@ -49,7 +80,7 @@ void GL3SceneGraphRenderer::walk_render(Node* node) {
 					geometry_node);
 			if (vao_node->first != geometry_node) {
 				LOGE("vao not found for vbo node in %s",
-						geometry_node->name.c_str());
+						geometry_node->getName().c_str());
 				exit(8);
 			}
 			GLuint vao = vao_node->second;
@@ -57,25 +88,49 @@ void GL3SceneGraphRenderer::walk_render(Node* node) {
 			glBindVertexArray(vao);
 			glBindBuffer(GL_ARRAY_BUFFER, vbo);
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-					(const GLvoid*) offsetof(Vertex, position));
-
 			glEnableVertexAttribArray(0);
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-					BUFFER_OFFSET(0));
-			glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE,
-					sizeof(Vertex), (const GLvoid*) offsetof(Vertex, normal));
 			glEnableVertexAttribArray(1);
-			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-					BUFFER_OFFSET(3 * sizeof(float)));
-			glVertexAttribPointer(2, 2, GL_UNSIGNED_BYTE, GL_TRUE,
-					sizeof(Vertex),
-					(const GLvoid*) offsetof(Vertex, texcoord));
 			glEnableVertexAttribArray(2);
-			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-					BUFFER_OFFSET(6 * sizeof(float)));
+			if (geometry_node->vertex_format == PackedVertexFormat) {
+				GLsizei stride = sizeof(PackedVertex);
+				glUniform1f(position_scale_uniform_location,
+						geometry_node->position_scale);
+				glUniform1f(packed_normal_uniform_location, 1.0f);
+				glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, stride,
+						(const GLvoid*) offsetof(PackedVertex, position));
+				glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride,
+						(const GLvoid*) offsetof(PackedVertex, normal));
+				glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride,
+						(const GLvoid*) offsetof(PackedVertex, texcoord));
+			} else {
+				glUniform1f(position_scale_uniform_location, 1.0f);
+				glUniform1f(packed_normal_uniform_location, 0.0f);
+				glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+						(const GLvoid*) offsetof(Vertex, position));
+				glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+						(const GLvoid*) offsetof(Vertex, normal));
+				glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+						(const GLvoid*) offsetof(Vertex, texcoord));
+			}
 
-			glDrawElements(GL_TRIANGLES, (GLsizei)(sizeof(GLuint) * geometry_node->index_data.size()), GL_UNSIGNED_INT, BUFFER_OFFSET(0));
+			glUniformMatrix4fv(matrix_uniform_location, 1, GL_FALSE, glm::value_ptr(model_matrix));
+			size_t level = geometry_node->selectLod(model_matrix, *camera, MESH_LOD_PIXEL_ERROR);
+			visibleIndexRanges(*geometry_node, level, model_matrix, *camera, draw_ranges);
+			if (geometry_node->submeshes.empty()) {
+				drawRanges(geometry_node, 0, (GLuint) geometry_node->indexCount());
+			} else {
+				// Every submesh of the level is drawn from the bound buffers with its own texture
+				LodLevel lod = geometry_node->lod(level);
+				for (std::vector<SubMesh>::iterator submesh = geometry_node->submeshes.begin();
+						submesh != geometry_node->submeshes.end(); ++submesh) {
+					if (submesh->first_index < lod.first_index
+							|| submesh->first_index >= lod.first_index + lod.index_count) {
+						continue;
+					}
+					bindMaterial(geometry_node->materials[submesh->material]);
+					drawRanges(geometry_node, submesh->first_index, submesh->first_index + submesh->index_count);
+				}
+			}
 			glDisableVertexAttribArray(2);
 			glDisableVertexAttribArray(1);
 			glDisableVertexAttribArray(0);
@@ -86,36 +141,39 @@ void GL3SceneGraphRenderer::walk_render(Node* node) {
 	} else if (node->type == NodeType::Material) {
 		MaterialNode* material_node = (MaterialNode*) node;
 		assert(material_node);
-		std::map<std::string, GLuint>::iterator texture_id_itr =
-				texture_ids.find(material_node->diffuse_texture);
-		if (texture_id_itr == texture_ids.end()) {
-			//LOGE("Unable to use texture %s", material_node->diffuse_texture.c_str());
-		} else {
-			GLuint texture_id = texture_id_itr->second;
-			glBindTexture(GL_TEXTURE_2D, texture_id);
-		}
+		bindMaterial(material_node);
 	} else if (node->type == NodeType::Transform) {
 		TransformNode* tn = (TransformNode*) node;
-		glUniformMatrix4fv(matrix_uniform_location, 1, GL_FALSE,
-				glm::value_ptr(tn->matrix));
+		// A current store lists the transforms in the order they are visited here. Otherwise the
+		// matrix is composed from the local ones, and transforms added since the store was built
+		// are not drawn until it is rebuilt.
+		if (transforms->current()) {
+			assert(next_transform < transforms->size() && transforms->handle(next_transform) == tn->transform);
+			// Nothing below a transform whose bounds are out of view is drawn
+			const BoundingSphere& bounds = transforms->bounds(next_transform);
+			if (bounds.radius < 0.f || !sphereInFrustum(view_planes, bounds.center, bounds.radius)) {
+				next_transform = transforms->subtreeEnd(next_transform);
+				model_matrix = parent_matrix;
+				return;
+			}
+			model_matrix = transforms->world(next_transform);
+			next_transform++;
+		} else if (transforms->contains(tn)) {
+			model_matrix = parent_matrix * transforms->getLocal(tn->transform);
+		} else {
+			model_matrix = parent_matrix;
+			return;
+		}
 	}
 	for (std::vector<Node*>::iterator it = node->children.begin();
 			it != node->children.end(); ++it) {
 		Node* child = *it;
-		walk_render(child);
+		walk_render(child, camera);
 	}
+	model_matrix = parent_matrix;
 }
 
-GL3SceneGraphRenderer::GL3SceneGraphRenderer(std::map<std::string, Image*>& images) {
-	for(std::map<std::string, Image*>::iterator it = images.begin(); it != images.end(); ++it) {
-		if(texture_ids.find(it->first) == texture_ids.end()) {
-			texture_ids.insert(std::make_pair(it->first, it->second->loadTexture()));
-			delete it->second;
-			it->second = 0;
-		}
-	}
-	images.clear();
-
+GL3SceneGraphRenderer::GL3SceneGraphRenderer() {
 	const char* vertex_shader_src =
 			"#version 300 es                            												\n"
 					"layout(location = 0) in vec3 vPosition;					        	    		\n"
@@ -126,15 +184,25 @@ GL3SceneGraphRenderer::GL3SceneGraphRenderer(std::map<std::string, Image*>& imag
 					"	mat4 modelview;               													\n"
 					"};																					\n"
 					"uniform mat4 matrix;																\n"
+					"uniform float positionScale;														\n"
+					"uniform float packedNormal;														\n"
 					"out vec3 fragPos;																	\n"
 					"out vec3 normal;																	\n"
 					"out vec2 texcoord;																	\n"
 					"out vec3 lightPos;																	\n"
+					"vec3 octDecode(vec2 e) {															\n"
+					"	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));									\n"
+					"	float t = max(-n.z, 0.0);														\n"
+					"	n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));				\n"
+					"	return normalize(n);															\n"
+					"}																					\n"
 					"void main() {																		\n"
+					"	vec4 position = vec4(vPosition * positionScale, 1.0);							\n"
+					"	vec3 vertexNormal = packedNormal > 0.5 ? octDecode(vNormal.xy) : vNormal;		\n"
 					"	gl_Position = projection * modelview											\n"
-					"		* matrix * vec4(vPosition, 1.0);											\n"
-					"	fragPos = vec3(modelview * matrix * vec4(vPosition, 1.0f));						\n"
-					"	normal = mat3(transpose(inverse(modelview * matrix))) * vNormal;				\n"
+					"		* matrix * position;														\n"
+					"	fragPos = vec3(modelview * matrix * position);									\n"
+					"	normal = mat3(transpose(inverse(modelview * matrix))) * vertexNormal;			\n"
 					"	vec3 lightPosIn = vec3(0.0, 10.0, 0.0);											\n"
 					"	lightPos = vec3(modelview * vec4(lightPosIn, 1.0));								\n"
 					"	texcoord = vTexCoord;															\n"
@@ -173,6 +241,8 @@ GL3SceneGraphRenderer::GL3SceneGraphRenderer(std::map<std::string, Image*>& imag
 	glUseProgram(shader_program);
 	glActiveTexture(GL_TEXTURE0);
 	matrix_uniform_location = glGetUniformLocation(shader_program, "matrix");
+	position_scale_uniform_location = glGetUniformLocation(shader_program, "positionScale");
+	packed_normal_uniform_location = glGetUniformLocation(shader_program, "packedNormal");
 	binding_point_index = 1;
 	// Retrieve the uniform block index
 	transform_block_id = glGetUniformBlockIndex(shader_program,
@@ -224,7 +294,7 @@ GL3SceneGraphRenderer::~GL3SceneGraphRenderer() {
 }
 
 
-void GL3SceneGraphRenderer::render(Node* node, Camera* camera) {
+void GL3SceneGraphRenderer::render(Node* node, const TransformStore& transform_store, Camera* camera) {
 	glEnable(GL_DEPTH_TEST);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glUseProgram(shader_program);
@@ -247,6 +317,24 @@ void GL3SceneGraphRenderer::render(Node* node, Camera* camera) {
 	glBufferSubData(GL_UNIFORM_BUFFER, matrix_size, matrix_size,
 			glm::value_ptr(camera->modelview_matrix));
 	glBindBuffer(GL_UNIFORM_BUFFER, 0);
-	walk_render(node);
+	model_matrix = glm::mat4(1.f);
+	transforms = &transform_store;
+	next_transform = 0;
+	extractFrustumPlanes(camera->projection_matrix * camera->modelview_matrix, view_planes);
+	walk_render(node, camera);
 	glUseProgram(0);
 }
+
+// Upload the images that have finished decoding since the last call, then free them
+void GL3SceneGraphRenderer::uploadTextures(DecodedImageQueue& decoded_images) {
+	std::pair<std::string, Image*> decoded;
+	while (decoded_images.tryPop(decoded)) {
+		if (texture_ids.find(decoded.first) == texture_ids.end()) {
+			if (!decoded.second->data) {
+				LOGE("Unable to use texture %s", decoded.first.c_str());
+			}
+			texture_ids.insert(std::make_pair(decoded.first, decoded.second->loadTexture()));
+		}
+		delete decoded.second;
+	}
+}
@@ -1,6 +1,8 @@
 // Copyright (C) 2017 Chris Liebert
 
 #define STB_IMAGE_IMPLEMENTATION
+// Images are decoded on several threads, the failure reason is a global in stb_image
+#define STBI_NO_FAILURE_STRINGS
 #include "stb_image.h"
 
 #include "graphics/gl_code.h"
@@ -11,8 +13,13 @@ static void checkGlError(const char* op) {
 	}
 }
 
-Image::Image(const char *filename, AssetManager *manager) {
-	Image();
+Image::Image(const char *filename, AssetManager *manager, MemoryBudget* _budget) {
+	w = 0;
+	h = 0;
+	comp = 0;
+	data = 0;
+	budget = _budget;
+	budget_bytes = 0;
 	if(!loadAsset(filename, manager)) {
 		LOGE("Unable to load image: %s", filename);
 	}
@@ -23,21 +30,36 @@ Image::Image() {
 	h = 0;
 	comp = 0;
 	data = 0;
+	budget = 0;
+	budget_bytes = 0;
 }
 
 Image::~Image() {
 	if(data) {
 		STBI_FREE(data);		
 	}
+	if(budget) {
+		budget->release(budget_bytes);
+	}
 }
 
 bool Image::loadAsset(const char* filename, AssetManager* manager) {
-    size_t file_length = 0;
-    unsigned char *image_file_bytes = manager->loadBinaryFile(filename, file_length);
-    if(file_length == 0) { return false; }
-    data = stbi_load_from_memory(image_file_bytes, (GLsizei)(file_length * sizeof(unsigned char)),
+    // Decode straight from the mapped file
+    AssetView image_view;
+    if(!manager->mapAsset(filename, image_view) || image_view.empty()) { return false; }
+    if(budget) {
+        // Wait until the decoded size fits in the budget, the header is enough to know it
+        if(!stbi_info_from_memory(image_view.data(), (int) image_view.size(), &w, &h, &comp)) {
+            return false;
+        }
+        size_t decoded_bytes = (size_t) w * (size_t) h * (size_t) comp;
+        if(!budget->acquire(decoded_bytes)) {
+            return false;
+        }
+        budget_bytes = decoded_bytes;
+    }
+    data = stbi_load_from_memory(image_view.data(), (int) image_view.size(),
                                         &w, &h, &comp, STBI_default);
-    delete [] image_file_bytes;
     if (data == 0) {
         return false;
     }
@@ -0,0 +1,342 @@
+// Copyright (C) 2017 Chris Liebert
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "common/log.h"
+#include "graphics/bounds.h"
+#include "graphics/gltf_factory.h"
+
+GltfSceneGraphFactory::GltfSceneGraphFactory(SceneArena* _arena)
+: arena(_arena) {
+	vertex_format = FloatVertexFormat;
+}
+
+GltfSceneGraphFactory::~GltfSceneGraphFactory() {
+	roots.clear();
+	textures.clear();
+}
+
+// Reads element i of a float accessor with n components
+static void readFloats(const unsigned char* data, size_t stride, size_t i, float* out, int n) {
+	memcpy(out, data + i * stride, n * sizeof(float));
+}
+
+// Texture coordinates may also be normalized unsigned bytes or shorts
+static bool readTexcoord(const gltf::Accessor& accessor, const unsigned char* data, size_t stride, size_t i,
+		float texcoord[2]) {
+	const unsigned char* element = data + i * stride;
+	switch (accessor.component_type) {
+	case GLTF_FLOAT:
+		memcpy(texcoord, element, 2 * sizeof(float));
+		return true;
+	case GLTF_UNSIGNED_BYTE:
+		texcoord[0] = element[0] / 255.f;
+		texcoord[1] = element[1] / 255.f;
+		return true;
+	case GLTF_UNSIGNED_SHORT: {
+		GLushort value[2];
+		memcpy(value, element, sizeof(value));
+		texcoord[0] = value[0] / 65535.f;
+		texcoord[1] = value[1] / 65535.f;
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+// Copies the indices, 16 bit indices are kept as they are when every vertex can be addressed
+static bool readIndices(const gltf::Document& document, const gltf::Primitive& primitive, GeometryNode* geom_node) {
+	size_t num_vertices = geom_node->vertex_data.size();
+	if (primitive.indices < 0) {
+		// Non-indexed primitives draw their vertices in order
+		size_t count = num_vertices - num_vertices % 3;
+		geom_node->index_data.resize(count);
+		for (size_t i = 0; i < count; i++) {
+			geom_node->index_data[i] = (GLuint) i;
+		}
+		geom_node->compactIndices();
+		return true;
+	}
+	if ((size_t) primitive.indices >= document.accessors.size()) {
+		return false;
+	}
+	const gltf::Accessor& accessor = document.accessors[primitive.indices];
+	size_t stride;
+	const unsigned char* data = gltf::accessorData(document, accessor, stride);
+	if (!data || accessor.components != 1) {
+		return false;
+	}
+	size_t count = accessor.count - accessor.count % 3;
+	if (accessor.component_type == GLTF_UNSIGNED_SHORT && stride == sizeof(GLushort) && num_vertices <= 65536) {
+		geom_node->index_data_16.resize(count);
+		memcpy(geom_node->index_data_16.data(), data, count * sizeof(GLushort));
+		geom_node->index_type = GL_UNSIGNED_SHORT;
+	} else {
+		geom_node->index_data.resize(count);
+		for (size_t i = 0; i < count; i++) {
+			const unsigned char* element = data + i * stride;
+			if (accessor.component_type == GLTF_UNSIGNED_BYTE) {
+				geom_node->index_data[i] = *element;
+			} else if (accessor.component_type == GLTF_UNSIGNED_SHORT) {
+				GLushort index;
+				memcpy(&index, element, sizeof(index));
+				geom_node->index_data[i] = index;
+			} else if (accessor.component_type == GLTF_UNSIGNED_INT) {
+				memcpy(&geom_node->index_data[i], element, sizeof(GLuint));
+			} else {
+				return false;
+			}
+		}
+		geom_node->compactIndices();
+	}
+	for (size_t i = 0; i < count; i++) {
+		if (geom_node->index(i) >= num_vertices) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Area weighted vertex normals for primitives that do not have any
+static void generateNormals(GeometryNode* geom_node) {
+	std::vector<Vertex>& vertices = geom_node->vertex_data;
+	for (size_t v = 0; v < vertices.size(); v++) {
+		vertices[v].normal[0] = vertices[v].normal[1] = vertices[v].normal[2] = 0.f;
+	}
+	size_t count = geom_node->indexCount();
+	for (size_t i = 0; i + 2 < count; i += 3) {
+		Vertex& v0 = vertices[geom_node->index(i)];
+		Vertex& v1 = vertices[geom_node->index(i + 1)];
+		Vertex& v2 = vertices[geom_node->index(i + 2)];
+		float e1[3], e2[3];
+		for (int k = 0; k < 3; k++) {
+			e1[k] = v1.position[k] - v0.position[k];
+			e2[k] = v2.position[k] - v0.position[k];
+		}
+		float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+		for (int k = 0; k < 3; k++) {
+			v0.normal[k] += n[k];
+			v1.normal[k] += n[k];
+			v2.normal[k] += n[k];
+		}
+	}
+	for (size_t v = 0; v < vertices.size(); v++) {
+		float* n = vertices[v].normal;
+		float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length > 0.f) {
+			n[0] /= length;
+			n[1] /= length;
+			n[2] /= length;
+		}
+	}
+}
+
+// Material, centering transform and geometry of one primitive, 0 when it cannot be drawn
+Node* GltfSceneGraphFactory::buildPrimitive(const gltf::Document& document, const gltf::Primitive& primitive,
+		const std::string& primitive_name, const std::string& directory) {
+	if (primitive.mode != GLTF_TRIANGLES) {
+		LOGI("Warning, only triangle primitives are supported, ommiting %s.", primitive_name.c_str());
+		return 0;
+	}
+	if (primitive.position < 0 || (size_t) primitive.position >= document.accessors.size()) {
+		return 0;
+	}
+	const gltf::Accessor& positions = document.accessors[primitive.position];
+	size_t position_stride;
+	const unsigned char* position_data = gltf::accessorData(document, positions, position_stride);
+	if (!position_data || positions.component_type != GLTF_FLOAT || positions.components != 3) {
+		LOGE("Invalid vertex positions in %s", primitive_name.c_str());
+		return 0;
+	}
+	const unsigned char* normal_data = 0;
+	size_t normal_stride = 0;
+	if (primitive.normal >= 0 && (size_t) primitive.normal < document.accessors.size()) {
+		const gltf::Accessor& normals = document.accessors[primitive.normal];
+		if (normals.component_type == GLTF_FLOAT && normals.components == 3 && normals.count == positions.count) {
+			normal_data = gltf::accessorData(document, normals, normal_stride);
+		}
+	}
+	const gltf::Accessor* texcoords = 0;
+	const unsigned char* texcoord_data = 0;
+	size_t texcoord_stride = 0;
+	if (primitive.texcoord >= 0 && (size_t) primitive.texcoord < document.accessors.size()) {
+		texcoords = &document.accessors[primitive.texcoord];
+		if (texcoords->components == 2 && texcoords->count == positions.count) {
+			texcoord_data = gltf::accessorData(document, *texcoords, texcoord_stride);
+		}
+	}
+
+	GeometryNode* geom_node = createNode<GeometryNode>(arena);
+	geom_node->setName(primitive_name + std::string("_Geometry"));
+	geom_node->vertex_data.resize(positions.count);
+	// The center is the mean of the vertices, they are stored relative to it
+	double center[3] = { 0.0, 0.0, 0.0 };
+	for (size_t i = 0; i < positions.count; i++) {
+		Vertex& vert = geom_node->vertex_data[i];
+		readFloats(position_data, position_stride, i, vert.position, 3);
+		if (normal_data) {
+			readFloats(normal_data, normal_stride, i, vert.normal, 3);
+		}
+		// glTF texture coordinates start at the top of the image, like the uploaded textures
+		if (!texcoord_data || !readTexcoord(*texcoords, texcoord_data, texcoord_stride, i, vert.texcoord)) {
+			vert.texcoord[0] = 0.f;
+			vert.texcoord[1] = 0.f;
+		}
+		for (int k = 0; k < 3; k++) {
+			center[k] += vert.position[k];
+		}
+	}
+	if (!readIndices(document, primitive, geom_node) || geom_node->indexCount() == 0) {
+		LOGE("Invalid indices in %s", primitive_name.c_str());
+		scenegraph::destroy(geom_node);
+		return 0;
+	}
+	if (!normal_data) {
+		generateNormals(geom_node);
+	}
+	for (int k = 0; k < 3; k++) {
+		geom_node->center[k] = (float) (center[k] / (double) positions.count);
+	}
+	for (size_t i = 0; i < geom_node->vertex_data.size(); i++) {
+		for (int k = 0; k < 3; k++) {
+			geom_node->vertex_data[i].position[k] -= geom_node->center[k];
+		}
+	}
+	computeBounds(geom_node);
+	if (geom_node->radius <= 0.f) {
+		geom_node->radius = 0.1f;
+	}
+	if (vertex_format == PackedVertexFormat) {
+		geom_node->packVertices();
+	}
+
+	MaterialNode* mat_node = createNode<MaterialNode>(arena);
+	if (primitive.material >= 0 && (size_t) primitive.material < document.materials.size()) {
+		const gltf::Material& material = document.materials[primitive.material];
+		mat_node->setName(material.name);
+		if (material.diffuse_texname.length() > 0) {
+			// Images are relative to the file that uses them
+			mat_node->diffuse_texture = directory + material.diffuse_texname;
+			textures.insert(mat_node->diffuse_texture);
+		}
+	}
+	TransformNode* trans_node = createNode<TransformNode>(arena);
+	trans_node->setName(primitive_name);
+	trans_node->matrix = glm::translate(glm::mat4(1.0f),
+			glm::vec3(geom_node->center[0], geom_node->center[1], geom_node->center[2]));
+	trans_node->children.push_back(geom_node);
+	mat_node->children.push_back(trans_node);
+	return mat_node;
+}
+
+Node* GltfSceneGraphFactory::buildNode(const gltf::Document& document, int node_index, const std::string& directory,
+		std::vector<bool>& on_path) {
+	if (node_index < 0 || (size_t) node_index >= document.nodes.size() || on_path[node_index]) {
+		LOGE("Invalid node %d in %s", node_index, name.c_str());
+		return 0;
+	}
+	on_path[node_index] = true;
+	const gltf::Node& node = document.nodes[node_index];
+	TransformNode* trans_node = createNode<TransformNode>(arena);
+	std::stringstream node_name;
+	if (node.name.length() > 0) {
+		node_name << node.name;
+	} else {
+		node_name << "Node." << node_index;
+	}
+	trans_node->setName(node_name.str());
+	trans_node->matrix = glm::make_mat4(node.matrix);
+	if (node.mesh >= 0 && (size_t) node.mesh < document.meshes.size()) {
+		// Nodes that reference the same mesh share its primitives
+		std::vector<Node*>& primitives = mesh_primitives[node.mesh];
+		if (!built_meshes[node.mesh]) {
+			built_meshes[node.mesh] = true;
+			const gltf::Mesh& mesh = document.meshes[node.mesh];
+			std::string mesh_name = mesh.name.length() > 0 ? mesh.name : trans_node->getName() + std::string("_Mesh");
+			for (size_t p = 0; p < mesh.primitives.size(); p++) {
+				std::stringstream primitive_name;
+				primitive_name << mesh_name;
+				if (mesh.primitives.size() > 1) {
+					primitive_name << "." << p;
+				}
+				Node* primitive = buildPrimitive(document, mesh.primitives[p], primitive_name.str(), directory);
+				if (primitive) {
+					primitives.push_back(primitive);
+					trans_node->children.push_back(primitive);
+				}
+			}
+		} else {
+			for (size_t p = 0; p < primitives.size(); p++) {
+				trans_node->children.push_back(scenegraph::share(primitives[p]));
+			}
+		}
+	}
+	for (size_t c = 0; c < node.children.size(); c++) {
+		Node* child = buildNode(document, node.children[c], directory, on_path);
+		if (child) {
+			trans_node->children.push_back(child);
+		}
+	}
+	on_path[node_index] = false;
+	return trans_node;
+}
+
+bool GltfSceneGraphFactory::addGltf(const char* file_name, glm::mat4 matrix, AssetManager* asset_manager) {
+	// Prevent file from being loaded more than once.
+	std::string filename_str(file_name);
+	if (gltf_files.find(filename_str) == gltf_files.end()) {
+		gltf_files.insert(filename_str);
+	} else {
+		LOGI("File %s was already loaded", file_name);
+		return true;
+	}
+	// The buffer views are read straight from the mapped asset
+	AssetView glb_view;
+	if (!asset_manager->mapAsset(file_name, glb_view)) {
+		return false;
+	}
+	gltf::Document document;
+	if (!gltf::parseGlb(glb_view.data(), glb_view.size(), document)) {
+		LOGE("Unable to parse %s", file_name);
+		return false;
+	}
+	std::stringstream namess;
+	namess << name << "[" << file_name << "]";
+	this->name = namess.str();
+	size_t separator = filename_str.find_last_of("/\\");
+	std::string directory = separator == std::string::npos ? std::string() : filename_str.substr(0, separator + 1);
+
+	size_t initial_num_roots = roots.size();
+	std::vector<bool> on_path(document.nodes.size(), false);
+	mesh_primitives.assign(document.meshes.size(), std::vector<Node*>());
+	built_meshes.assign(document.meshes.size(), false);
+	for (size_t i = 0; i < document.scene_nodes.size(); i++) {
+		Node* root = buildNode(document, document.scene_nodes[i], directory, on_path);
+		if (root) {
+			TransformNode* trans_node = (TransformNode*) root;
+			trans_node->matrix = matrix * trans_node->matrix;
+			roots.push_back(root);
+		}
+	}
+	if (roots.size() == initial_num_roots) {
+		LOGE("Error: No scene nodes defined in %s", file_name);
+		return false;
+	}
+	mesh_primitives.clear();
+	built_meshes.clear();
+	return true;
+}
+
+Node* GltfSceneGraphFactory::build() {
+	Node* group = createNode<Node>(arena);
+	group->setName(name);
+	group->children.swap(roots);
+	return group;
+}
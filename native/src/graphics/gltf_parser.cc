@@ -0,0 +1,545 @@
+// Copyright (C) 2017 Chris Liebert
+
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+#include "graphics/gltf_parser.h"
+
+#define GLB_MAGIC 0x46546C67u
+#define GLB_CHUNK_JSON 0x4E4F534Au
+#define GLB_CHUNK_BIN 0x004E4942u
+
+// Deeper JSON nesting is rejected so hostile files cannot exhaust the stack
+#ifndef GLTF_MAX_JSON_DEPTH
+#define GLTF_MAX_JSON_DEPTH 64
+#endif
+
+namespace gltf {
+
+typedef struct JsonValue {
+	enum Type {
+		Null, Boolean, Number, String, Array, Object
+	} type;
+	double number;
+	std::string string;
+	// Array elements, or object members named by the matching keys
+	std::vector<JsonValue> elements;
+	std::vector<std::string> keys;
+
+	JsonValue() : type(Null), number(0.0) {}
+
+	const JsonValue* member(const char* key) const {
+		if (type != Object) {
+			return 0;
+		}
+		for (size_t i = 0; i < keys.size(); i++) {
+			if (keys[i] == key) {
+				return &elements[i];
+			}
+		}
+		return 0;
+	}
+} JsonValue;
+
+class JsonParser {
+public:
+	JsonParser(const char* begin, const char* end) : p(begin), end(end), depth(0) {}
+
+	bool parse(JsonValue& value) {
+		if (!parseValue(value)) {
+			return false;
+		}
+		skipSpace();
+		return p == end;
+	}
+private:
+	const char* p;
+	const char* end;
+	int depth;
+
+	void skipSpace() {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+			p++;
+		}
+	}
+
+	bool consume(char c) {
+		skipSpace();
+		if (p < end && *p == c) {
+			p++;
+			return true;
+		}
+		return false;
+	}
+
+	bool parseLiteral(const char* literal) {
+		size_t length = strlen(literal);
+		if ((size_t) (end - p) < length || strncmp(p, literal, length) != 0) {
+			return false;
+		}
+		p += length;
+		return true;
+	}
+
+	static void appendUtf8(std::string& out, unsigned code_point) {
+		if (code_point < 0x80) {
+			out += (char) code_point;
+		} else if (code_point < 0x800) {
+			out += (char) (0xC0 | (code_point >> 6));
+			out += (char) (0x80 | (code_point & 0x3F));
+		} else if (code_point < 0x10000) {
+			out += (char) (0xE0 | (code_point >> 12));
+			out += (char) (0x80 | ((code_point >> 6) & 0x3F));
+			out += (char) (0x80 | (code_point & 0x3F));
+		} else {
+			out += (char) (0xF0 | (code_point >> 18));
+			out += (char) (0x80 | ((code_point >> 12) & 0x3F));
+			out += (char) (0x80 | ((code_point >> 6) & 0x3F));
+			out += (char) (0x80 | (code_point & 0x3F));
+		}
+	}
+
+	bool parseHex4(unsigned& value) {
+		if (end - p < 4) {
+			return false;
+		}
+		value = 0;
+		for (int i = 0; i < 4; i++, p++) {
+			char c = *p;
+			value <<= 4;
+			if (c >= '0' && c <= '9') {
+				value |= (unsigned) (c - '0');
+			} else if (c >= 'a' && c <= 'f') {
+				value |= (unsigned) (c - 'a' + 10);
+			} else if (c >= 'A' && c <= 'F') {
+				value |= (unsigned) (c - 'A' + 10);
+			} else {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool parseString(std::string& out) {
+		if (!consume('"')) {
+			return false;
+		}
+		out.clear();
+		while (p < end) {
+			char c = *p++;
+			if (c == '"') {
+				return true;
+			}
+			if (c != '\\') {
+				out += c;
+				continue;
+			}
+			if (p == end) {
+				return false;
+			}
+			c = *p++;
+			switch (c) {
+			case '"': case '\\': case '/': out += c; break;
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u': {
+				unsigned code_point;
+				if (!parseHex4(code_point)) {
+					return false;
+				}
+				// Combine a surrogate pair
+				if (code_point >= 0xD800 && code_point < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+					p += 2;
+					unsigned low;
+					if (!parseHex4(low)) {
+						return false;
+					}
+					code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+				}
+				appendUtf8(out, code_point);
+				break;
+			}
+			default:
+				return false;
+			}
+		}
+		return false;
+	}
+
+	bool parseNumber(double& number) {
+		// The number is copied so strtod cannot read past the end of the chunk
+		char buffer[64];
+		size_t length = 0;
+		while (p < end && length < sizeof(buffer) - 1
+				&& ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E')) {
+			buffer[length++] = *p++;
+		}
+		if (length == 0) {
+			return false;
+		}
+		buffer[length] = '\0';
+		char* number_end;
+		number = strtod(buffer, &number_end);
+		return number_end == buffer + length;
+	}
+
+	bool parseValue(JsonValue& value) {
+		skipSpace();
+		if (p == end) {
+			return false;
+		}
+		switch (*p) {
+		case '{':
+			return parseObject(value);
+		case '[':
+			return parseArray(value);
+		case '"':
+			value.type = JsonValue::String;
+			return parseString(value.string);
+		case 't':
+			value.type = JsonValue::Boolean;
+			value.number = 1.0;
+			return parseLiteral("true");
+		case 'f':
+			value.type = JsonValue::Boolean;
+			value.number = 0.0;
+			return parseLiteral("false");
+		case 'n':
+			value.type = JsonValue::Null;
+			return parseLiteral("null");
+		default:
+			value.type = JsonValue::Number;
+			return parseNumber(value.number);
+		}
+	}
+
+	bool parseArray(JsonValue& value) {
+		if (++depth > GLTF_MAX_JSON_DEPTH) {
+			return false;
+		}
+		p++;
+		value.type = JsonValue::Array;
+		if (!consume(']')) {
+			do {
+				value.elements.push_back(JsonValue());
+				if (!parseValue(value.elements.back())) {
+					return false;
+				}
+			} while (consume(','));
+			if (!consume(']')) {
+				return false;
+			}
+		}
+		depth--;
+		return true;
+	}
+
+	bool parseObject(JsonValue& value) {
+		if (++depth > GLTF_MAX_JSON_DEPTH) {
+			return false;
+		}
+		p++;
+		value.type = JsonValue::Object;
+		if (!consume('}')) {
+			do {
+				value.keys.push_back(std::string());
+				value.elements.push_back(JsonValue());
+				if (!parseString(value.keys.back()) || !consume(':') || !parseValue(value.elements.back())) {
+					return false;
+				}
+			} while (consume(','));
+			if (!consume('}')) {
+				return false;
+			}
+		}
+		depth--;
+		return true;
+	}
+};
+
+static uint32_t readUint32(const unsigned char* p) {
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static int intMember(const JsonValue& object, const char* key, int fallback) {
+	const JsonValue* value = object.member(key);
+	return value && value->type == JsonValue::Number ? (int) value->number : fallback;
+}
+
+static size_t sizeMember(const JsonValue& object, const char* key) {
+	const JsonValue* value = object.member(key);
+	return value && value->type == JsonValue::Number && value->number > 0.0 ? (size_t) value->number : 0;
+}
+
+static std::string stringMember(const JsonValue& object, const char* key) {
+	const JsonValue* value = object.member(key);
+	return value && value->type == JsonValue::String ? value->string : std::string();
+}
+
+// Elements of an array member, empty when it is missing
+static const std::vector<JsonValue>& arrayMember(const JsonValue& object, const char* key) {
+	static const std::vector<JsonValue> empty;
+	const JsonValue* value = object.member(key);
+	return value && value->type == JsonValue::Array ? value->elements : empty;
+}
+
+static int accessorComponents(const std::string& type) {
+	if (type == "SCALAR") return 1;
+	if (type == "VEC2") return 2;
+	if (type == "VEC3") return 3;
+	if (type == "VEC4" || type == "MAT2") return 4;
+	if (type == "MAT3") return 9;
+	if (type == "MAT4") return 16;
+	return 0;
+}
+
+// Column major translation * rotation * scale
+static void composeMatrix(const float t[3], const float q[4], const float s[3], float m[16]) {
+	float x = q[0], y = q[1], z = q[2], w = q[3];
+	float rotation[9] = {
+		1.f - 2.f * (y * y + z * z), 2.f * (x * y + z * w), 2.f * (x * z - y * w),
+		2.f * (x * y - z * w), 1.f - 2.f * (x * x + z * z), 2.f * (y * z + x * w),
+		2.f * (x * z + y * w), 2.f * (y * z - x * w), 1.f - 2.f * (x * x + y * y)
+	};
+	for (int column = 0; column < 3; column++) {
+		for (int row = 0; row < 3; row++) {
+			m[4 * column + row] = rotation[3 * column + row] * s[column];
+		}
+		m[4 * column + 3] = 0.f;
+		m[12 + column] = t[column];
+	}
+	m[15] = 1.f;
+}
+
+static void readVector(const JsonValue& object, const char* key, float* out, int n) {
+	const std::vector<JsonValue>& elements = arrayMember(object, key);
+	if ((int) elements.size() != n) {
+		return;
+	}
+	for (int i = 0; i < n; i++) {
+		if (elements[i].type == JsonValue::Number) {
+			out[i] = (float) elements[i].number;
+		}
+	}
+}
+
+static void readNode(const JsonValue& json, Node& node) {
+	node.name = stringMember(json, "name");
+	node.mesh = intMember(json, "mesh", -1);
+	const std::vector<JsonValue>& children = arrayMember(json, "children");
+	for (size_t i = 0; i < children.size(); i++) {
+		if (children[i].type == JsonValue::Number) {
+			node.children.push_back((int) children[i].number);
+		}
+	}
+	float translation[3] = { 0.f, 0.f, 0.f };
+	float rotation[4] = { 0.f, 0.f, 0.f, 1.f };
+	float scale[3] = { 1.f, 1.f, 1.f };
+	readVector(json, "translation", translation, 3);
+	readVector(json, "rotation", rotation, 4);
+	readVector(json, "scale", scale, 3);
+	composeMatrix(translation, rotation, scale, node.matrix);
+	readVector(json, "matrix", node.matrix, 16);
+}
+
+// The image file used by a texture, empty for images stored in buffers or data uris
+static std::string textureImage(const JsonValue& root, int texture) {
+	const std::vector<JsonValue>& textures = arrayMember(root, "textures");
+	if (texture < 0 || (size_t) texture >= textures.size()) {
+		return std::string();
+	}
+	int source = intMember(textures[texture], "source", -1);
+	const std::vector<JsonValue>& images = arrayMember(root, "images");
+	if (source < 0 || (size_t) source >= images.size()) {
+		return std::string();
+	}
+	std::string uri = stringMember(images[source], "uri");
+	if (uri.compare(0, 5, "data:") == 0) {
+		return std::string();
+	}
+	return uri;
+}
+
+static void readMaterial(const JsonValue& root, const JsonValue& json, Material& material) {
+	material.name = stringMember(json, "name");
+	const JsonValue* pbr = json.member("pbrMetallicRoughness");
+	const JsonValue* base_color = pbr ? pbr->member("baseColorTexture") : 0;
+	if (base_color) {
+		material.diffuse_texname = textureImage(root, intMember(*base_color, "index", -1));
+	}
+}
+
+static void readDocument(const JsonValue& root, Document& document) {
+	const std::vector<JsonValue>& buffer_views = arrayMember(root, "bufferViews");
+	document.buffer_views.resize(buffer_views.size());
+	for (size_t i = 0; i < buffer_views.size(); i++) {
+		BufferView& view = document.buffer_views[i];
+		view.byte_stride = sizeMember(buffer_views[i], "byteStride");
+		view.byte_offset = 0;
+		view.byte_length = 0;
+		if (intMember(buffer_views[i], "buffer", 0) == 0) {
+			view.byte_offset = sizeMember(buffer_views[i], "byteOffset");
+			view.byte_length = sizeMember(buffer_views[i], "byteLength");
+		}
+	}
+	// Only the first buffer can be the binary chunk, and only when it has no uri
+	const std::vector<JsonValue>& buffers = arrayMember(root, "buffers");
+	if (!buffers.empty() && buffers[0].member("uri")) {
+		for (size_t i = 0; i < document.buffer_views.size(); i++) {
+			document.buffer_views[i].byte_length = 0;
+		}
+	}
+
+	const std::vector<JsonValue>& accessors = arrayMember(root, "accessors");
+	document.accessors.resize(accessors.size());
+	for (size_t i = 0; i < accessors.size(); i++) {
+		Accessor& accessor = document.accessors[i];
+		accessor.buffer_view = intMember(accessors[i], "bufferView", -1);
+		accessor.byte_offset = sizeMember(accessors[i], "byteOffset");
+		accessor.component_type = intMember(accessors[i], "componentType", 0);
+		accessor.components = accessorComponents(stringMember(accessors[i], "type"));
+		const JsonValue* normalized = accessors[i].member("normalized");
+		accessor.normalized = normalized && normalized->type == JsonValue::Boolean && normalized->number != 0.0;
+		accessor.count = sizeMember(accessors[i], "count");
+	}
+
+	const std::vector<JsonValue>& meshes = arrayMember(root, "meshes");
+	document.meshes.resize(meshes.size());
+	for (size_t i = 0; i < meshes.size(); i++) {
+		Mesh& mesh = document.meshes[i];
+		mesh.name = stringMember(meshes[i], "name");
+		const std::vector<JsonValue>& primitives = arrayMember(meshes[i], "primitives");
+		for (size_t j = 0; j < primitives.size(); j++) {
+			Primitive primitive;
+			const JsonValue* attributes = primitives[j].member("attributes");
+			primitive.position = attributes ? intMember(*attributes, "POSITION", -1) : -1;
+			primitive.normal = attributes ? intMember(*attributes, "NORMAL", -1) : -1;
+			primitive.texcoord = attributes ? intMember(*attributes, "TEXCOORD_0", -1) : -1;
+			primitive.indices = intMember(primitives[j], "indices", -1);
+			primitive.material = intMember(primitives[j], "material", -1);
+			primitive.mode = intMember(primitives[j], "mode", GLTF_TRIANGLES);
+			mesh.primitives.push_back(primitive);
+		}
+	}
+
+	const std::vector<JsonValue>& nodes = arrayMember(root, "nodes");
+	document.nodes.resize(nodes.size());
+	for (size_t i = 0; i < nodes.size(); i++) {
+		readNode(nodes[i], document.nodes[i]);
+	}
+
+	const std::vector<JsonValue>& materials = arrayMember(root, "materials");
+	document.materials.resize(materials.size());
+	for (size_t i = 0; i < materials.size(); i++) {
+		readMaterial(root, materials[i], document.materials[i]);
+	}
+
+	const std::vector<JsonValue>& scenes = arrayMember(root, "scenes");
+	int scene = intMember(root, "scene", 0);
+	if (scene >= 0 && (size_t) scene < scenes.size()) {
+		const std::vector<JsonValue>& scene_nodes = arrayMember(scenes[scene], "nodes");
+		for (size_t i = 0; i < scene_nodes.size(); i++) {
+			if (scene_nodes[i].type == JsonValue::Number) {
+				document.scene_nodes.push_back((int) scene_nodes[i].number);
+			}
+		}
+	} else {
+		// Without scenes every node that is not a child is a root
+		std::vector<bool> is_child(document.nodes.size(), false);
+		for (size_t i = 0; i < document.nodes.size(); i++) {
+			for (size_t c = 0; c < document.nodes[i].children.size(); c++) {
+				int child = document.nodes[i].children[c];
+				if (child >= 0 && (size_t) child < is_child.size()) {
+					is_child[child] = true;
+				}
+			}
+		}
+		for (size_t i = 0; i < document.nodes.size(); i++) {
+			if (!is_child[i]) {
+				document.scene_nodes.push_back((int) i);
+			}
+		}
+	}
+}
+
+bool parseGlb(const unsigned char* data, size_t length, Document& document) {
+	document.binary = 0;
+	document.binary_length = 0;
+	if (length < 20 || readUint32(data) != GLB_MAGIC || readUint32(data + 4) != 2) {
+		return false;
+	}
+	size_t total_length = readUint32(data + 8);
+	if (total_length > length) {
+		return false;
+	}
+	const char* json_begin = 0;
+	const char* json_end = 0;
+	for (size_t offset = 12; offset + 8 <= total_length;) {
+		size_t chunk_length = readUint32(data + offset);
+		uint32_t chunk_type = readUint32(data + offset + 4);
+		const unsigned char* chunk = data + offset + 8;
+		if (chunk_length > total_length - offset - 8) {
+			return false;
+		}
+		if (chunk_type == GLB_CHUNK_JSON && !json_begin) {
+			json_begin = (const char*) chunk;
+			json_end = json_begin + chunk_length;
+		} else if (chunk_type == GLB_CHUNK_BIN && !document.binary) {
+			document.binary = chunk;
+			document.binary_length = chunk_length;
+		}
+		// Chunks are 4 byte aligned
+		offset += 8 + ((chunk_length + 3) & ~(size_t) 3);
+	}
+	if (!json_begin) {
+		return false;
+	}
+	JsonValue root;
+	JsonParser parser(json_begin, json_end);
+	if (!parser.parse(root) || root.type != JsonValue::Object) {
+		return false;
+	}
+	readDocument(root, document);
+	return true;
+}
+
+size_t componentSize(int component_type) {
+	switch (component_type) {
+	case GLTF_BYTE:
+	case GLTF_UNSIGNED_BYTE:
+		return 1;
+	case GLTF_SHORT:
+	case GLTF_UNSIGNED_SHORT:
+		return 2;
+	case GLTF_UNSIGNED_INT:
+	case GLTF_FLOAT:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+const unsigned char* accessorData(const Document& document, const Accessor& accessor, size_t& stride) {
+	if (accessor.buffer_view < 0 || (size_t) accessor.buffer_view >= document.buffer_views.size()
+			|| accessor.count == 0 || !document.binary) {
+		return 0;
+	}
+	const BufferView& view = document.buffer_views[accessor.buffer_view];
+	size_t element_size = componentSize(accessor.component_type) * (size_t) accessor.components;
+	if (element_size == 0) {
+		return 0;
+	}
+	stride = view.byte_stride ? view.byte_stride : element_size;
+	if (view.byte_offset > document.binary_length || view.byte_length > document.binary_length - view.byte_offset
+			|| stride < element_size || accessor.byte_offset + element_size > view.byte_length
+			|| (accessor.count - 1) > (view.byte_length - accessor.byte_offset - element_size) / stride) {
+		return 0;
+	}
+	return document.binary + view.byte_offset + accessor.byte_offset;
+}
+
+} // namespace gltf
@@ -0,0 +1,295 @@
+// Copyright (C) 2017 Chris Liebert
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#include "common/asset_view.hpp"
+#include "common/log.h"
+#include "graphics/mesh_cache.h"
+
+using namespace scenegraph;
+
+typedef struct MeshCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t key;
+	uint32_t num_materials;
+	uint32_t num_geometry_nodes;
+} MeshCacheHeader;
+
+// Bounds checked reads from a mapped cache file
+class MeshCacheReader {
+public:
+	MeshCacheReader(const unsigned char* _data, size_t _length)
+	: data(_data), length(_length), position(0), failed(false) {}
+
+	bool read(void* out, size_t n) {
+		if (failed || n > length - position) {
+			failed = true;
+			return false;
+		}
+		memcpy(out, data + position, n);
+		position += n;
+		return true;
+	}
+
+	bool readString(std::string& s) {
+		uint32_t n = 0;
+		if (!read(&n, sizeof(n)) || n > length - position) {
+			failed = true;
+			return false;
+		}
+		s.assign((const char*) data + position, n);
+		position += n;
+		return true;
+	}
+
+	// Interns the string straight from the mapped data
+	bool readName(NameId& id) {
+		uint32_t n = 0;
+		if (!read(&n, sizeof(n)) || n > length - position) {
+			failed = true;
+			return false;
+		}
+		id = StringInterner::global().intern((const char*) data + position, n);
+		position += n;
+		return true;
+	}
+
+	template<typename T>
+	bool readVector(std::vector<T>& v) {
+		uint32_t n = 0;
+		if (!read(&n, sizeof(n)) || (size_t) n > (length - position) / sizeof(T)) {
+			failed = true;
+			return false;
+		}
+		v.resize(n);
+		return read(v.data(), n * sizeof(T));
+	}
+
+	// Marks data that was read but is not valid
+	void fail() { failed = true; }
+	bool ok() const { return !failed; }
+private:
+	const unsigned char* data;
+	size_t length;
+	size_t position;
+	bool failed;
+};
+
+class MeshCacheWriter {
+public:
+	MeshCacheWriter(FILE* _file) : file(_file), failed(false) {}
+
+	void write(const void* data, size_t n) {
+		if (!failed && n > 0 && fwrite(data, 1, n, file) != n) {
+			failed = true;
+		}
+	}
+
+	void writeString(const std::string& s) {
+		uint32_t n = (uint32_t) s.size();
+		write(&n, sizeof(n));
+		write(s.data(), n);
+	}
+
+	template<typename T>
+	void writeVector(const std::vector<T>& v) {
+		uint32_t n = (uint32_t) v.size();
+		write(&n, sizeof(n));
+		write(v.data(), n * sizeof(T));
+	}
+
+	bool ok() const { return !failed; }
+private:
+	FILE* file;
+	bool failed;
+};
+
+MeshCache::MeshCache(const std::string& _directory) : directory(_directory) {
+	if (!directory.empty()) {
+		// The directory may already exist
+#ifdef _MSC_VER
+		_mkdir(directory.c_str());
+#else
+		mkdir(directory.c_str(), 0755);
+#endif
+	}
+}
+
+bool MeshCache::enabled() const {
+	return !directory.empty();
+}
+
+std::string MeshCache::path(uint64_t key) const {
+	char filename[64];
+	snprintf(filename, sizeof(filename), "%016llx.mesh", (unsigned long long) key);
+	return directory + "/" + filename;
+}
+
+bool MeshCache::load(uint64_t key, CachedMesh& mesh, SceneArena* arena) const {
+	if (!enabled()) {
+		return false;
+	}
+	AssetView view;
+	std::string cache_path = path(key);
+	if (!AssetView::mapFile(cache_path.c_str(), view) || view.empty()) {
+		return false;
+	}
+	MeshCacheReader reader(view.data(), view.size());
+	MeshCacheHeader header;
+	if (!reader.read(&header, sizeof(header))
+			|| 0 != memcmp(header.magic, MESH_CACHE_MAGIC, 4)
+			|| header.version != MESH_CACHE_VERSION
+			|| header.key != key) {
+		LOGI("Ignoring out of date mesh cache %s", cache_path.c_str());
+		return false;
+	}
+	for (uint32_t i = 0; reader.ok() && i < header.num_materials; i++) {
+		MaterialNode* mat_node = createNode<MaterialNode>(arena);
+		reader.readName(mat_node->name);
+		reader.readString(mat_node->diffuse_texture);
+		mesh.materials.push_back(mat_node);
+	}
+	for (uint32_t i = 0; reader.ok() && i < header.num_geometry_nodes; i++) {
+		GeometryNode* geom_node = createNode<GeometryNode>(arena);
+		int32_t material = -1;
+		reader.readName(geom_node->name);
+		reader.read(geom_node->center, sizeof(geom_node->center));
+		reader.read(geom_node->aabb_min, sizeof(geom_node->aabb_min));
+		reader.read(geom_node->aabb_max, sizeof(geom_node->aabb_max));
+		reader.read(geom_node->sphere_center, sizeof(geom_node->sphere_center));
+		reader.read(&geom_node->radius, sizeof(geom_node->radius));
+		reader.read(&material, sizeof(material));
+		uint32_t index_type = GL_UNSIGNED_INT;
+		reader.read(&index_type, sizeof(index_type));
+		geom_node->index_type = (GLenum) index_type;
+		uint32_t vertex_format = FloatVertexFormat;
+		reader.read(&vertex_format, sizeof(vertex_format));
+		geom_node->vertex_format = (VertexFormat) vertex_format;
+		if (geom_node->vertex_format == PackedVertexFormat) {
+			reader.read(&geom_node->position_scale, sizeof(geom_node->position_scale));
+			reader.readVector(geom_node->packed_vertex_data);
+		} else {
+			reader.readVector(geom_node->vertex_data);
+		}
+		if (geom_node->index_type == GL_UNSIGNED_SHORT) {
+			reader.readVector(geom_node->index_data_16);
+		} else {
+			reader.readVector(geom_node->index_data);
+		}
+		reader.readVector(geom_node->lods);
+		reader.readVector(geom_node->clusters);
+		reader.readVector(geom_node->submeshes);
+		std::vector<int32_t> submesh_materials;
+		reader.readVector(submesh_materials);
+		for (size_t m = 0; m < submesh_materials.size(); m++) {
+			int32_t index = submesh_materials[m];
+			geom_node->materials.push_back(index >= 0 && (size_t) index < mesh.materials.size()
+					? mesh.materials[index] : (MaterialNode*) 0);
+		}
+		for (size_t m = 0; m < geom_node->submeshes.size(); m++) {
+			if (geom_node->submeshes[m].material >= geom_node->materials.size()) {
+				reader.fail();
+			}
+		}
+		mesh.geometry_nodes.push_back(geom_node);
+		mesh.geometry_materials.push_back((int) material);
+	}
+	if (!reader.ok()) {
+		LOGE("Mesh cache %s is corrupt", cache_path.c_str());
+		for (size_t i = 0; i < mesh.materials.size(); i++) {
+			scenegraph::destroy(mesh.materials[i]);
+		}
+		for (size_t i = 0; i < mesh.geometry_nodes.size(); i++) {
+			scenegraph::destroy(mesh.geometry_nodes[i]);
+		}
+		mesh.materials.clear();
+		mesh.geometry_nodes.clear();
+		mesh.geometry_materials.clear();
+		return false;
+	}
+	return true;
+}
+
+bool MeshCache::save(uint64_t key, const CachedMesh& mesh) const {
+	if (!enabled()) {
+		return false;
+	}
+	std::string cache_path = path(key);
+	// Written under a temporary name so a partial file is never loaded
+	std::string temp_path = cache_path + ".tmp";
+	FILE* file = fopen(temp_path.c_str(), "wb");
+	if (file == 0) {
+		LOGI("Unable to create mesh cache %s", temp_path.c_str());
+		return false;
+	}
+	MeshCacheWriter writer(file);
+	MeshCacheHeader header;
+	memcpy(header.magic, MESH_CACHE_MAGIC, 4);
+	header.version = MESH_CACHE_VERSION;
+	header.key = key;
+	header.num_materials = (uint32_t) mesh.materials.size();
+	header.num_geometry_nodes = (uint32_t) mesh.geometry_nodes.size();
+	writer.write(&header, sizeof(header));
+	for (size_t i = 0; i < mesh.materials.size(); i++) {
+		writer.writeString(mesh.materials[i]->getName());
+		writer.writeString(mesh.materials[i]->diffuse_texture);
+	}
+	for (size_t i = 0; i < mesh.geometry_nodes.size(); i++) {
+		GeometryNode* geom_node = mesh.geometry_nodes[i];
+		int32_t material = (int32_t) mesh.geometry_materials[i];
+		writer.writeString(geom_node->getName());
+		writer.write(geom_node->center, sizeof(geom_node->center));
+		writer.write(geom_node->aabb_min, sizeof(geom_node->aabb_min));
+		writer.write(geom_node->aabb_max, sizeof(geom_node->aabb_max));
+		writer.write(geom_node->sphere_center, sizeof(geom_node->sphere_center));
+		writer.write(&geom_node->radius, sizeof(geom_node->radius));
+		writer.write(&material, sizeof(material));
+		uint32_t index_type = (uint32_t) geom_node->index_type;
+		writer.write(&index_type, sizeof(index_type));
+		uint32_t vertex_format = (uint32_t) geom_node->vertex_format;
+		writer.write(&vertex_format, sizeof(vertex_format));
+		if (geom_node->vertex_format == PackedVertexFormat) {
+			writer.write(&geom_node->position_scale, sizeof(geom_node->position_scale));
+			writer.writeVector(geom_node->packed_vertex_data);
+		} else {
+			writer.writeVector(geom_node->vertex_data);
+		}
+		if (geom_node->index_type == GL_UNSIGNED_SHORT) {
+			writer.writeVector(geom_node->index_data_16);
+		} else {
+			writer.writeVector(geom_node->index_data);
+		}
+		writer.writeVector(geom_node->lods);
+		writer.writeVector(geom_node->clusters);
+		writer.writeVector(geom_node->submeshes);
+		std::vector<int32_t> submesh_materials;
+		for (size_t m = 0; m < geom_node->materials.size(); m++) {
+			std::vector<MaterialNode*>::const_iterator it = std::find(mesh.materials.begin(), mesh.materials.end(),
+					geom_node->materials[m]);
+			submesh_materials.push_back(it == mesh.materials.end() ? -1 : (int32_t) (it - mesh.materials.begin()));
+		}
+		writer.writeVector(submesh_materials);
+	}
+	fclose(file);
+	if (!writer.ok()) {
+		remove(temp_path.c_str());
+		LOGI("Unable to write mesh cache %s", temp_path.c_str());
+		return false;
+	}
+	remove(cache_path.c_str());
+	if (rename(temp_path.c_str(), cache_path.c_str()) != 0) {
+		remove(temp_path.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,149 @@
+// Copyright (C) 2017 Chris Liebert
+
+#include <algorithm>
+#include <cmath>
+
+#include "graphics/mesh_clusters.h"
+
+#define NO_CLUSTER 0xFFFFFFFFu
+
+using scenegraph::GeometryNode;
+using scenegraph::IndexRange;
+using scenegraph::LodLevel;
+using scenegraph::MeshCluster;
+using scenegraph::Vertex;
+
+static void computeClusterBounds(const GeometryNode* geom_node, MeshCluster& cluster) {
+	const std::vector<GLuint>& indices = geom_node->index_data;
+	const std::vector<Vertex>& vertices = geom_node->vertex_data;
+	size_t end = cluster.first_index + cluster.index_count;
+
+	float min[3], max[3];
+	for (int k = 0; k < 3; k++) {
+		min[k] = max[k] = vertices[indices[cluster.first_index]].position[k];
+	}
+	for (size_t i = cluster.first_index; i < end; i++) {
+		const float* p = vertices[indices[i]].position;
+		for (int k = 0; k < 3; k++) {
+			min[k] = std::min(min[k], p[k]);
+			max[k] = std::max(max[k], p[k]);
+		}
+	}
+	float radius_squared = 0.f;
+	for (int k = 0; k < 3; k++) {
+		cluster.center[k] = 0.5f * (min[k] + max[k]);
+	}
+	for (size_t i = cluster.first_index; i < end; i++) {
+		const float* p = vertices[indices[i]].position;
+		float dx = p[0] - cluster.center[0], dy = p[1] - cluster.center[1], dz = p[2] - cluster.center[2];
+		radius_squared = std::max(radius_squared, dx * dx + dy * dy + dz * dz);
+	}
+	cluster.radius = sqrtf(radius_squared);
+}
+
+void buildClusters(GeometryNode* geom_node) {
+	geom_node->clusters.clear();
+	LodLevel full_detail = geom_node->lod(0);
+	size_t num_triangles = full_detail.index_count / 3;
+	if (num_triangles <= MESH_CLUSTER_MAX_TRIANGLES) {
+		// Culling the whole node is enough
+		return;
+	}
+	const std::vector<GLuint>& indices = geom_node->index_data;
+	// Vertices already counted for the current cluster are marked with its number
+	std::vector<GLuint> vertex_cluster(geom_node->vertex_data.size(), NO_CLUSTER);
+	MeshCluster cluster;
+	cluster.first_index = full_detail.first_index;
+	cluster.index_count = 0;
+	GLuint cluster_number = 0;
+	size_t cluster_vertices = 0;
+	for (size_t t = 0; t < num_triangles; t++) {
+		size_t first = full_detail.first_index + 3 * t;
+		size_t new_vertices = 0;
+		for (int c = 0; c < 3; c++) {
+			GLuint v = indices[first + c];
+			if (vertex_cluster[v] != cluster_number) {
+				new_vertices++;
+			}
+		}
+		if (cluster.index_count / 3 == MESH_CLUSTER_MAX_TRIANGLES
+				|| cluster_vertices + new_vertices > MESH_CLUSTER_MAX_VERTICES) {
+			computeClusterBounds(geom_node, cluster);
+			geom_node->clusters.push_back(cluster);
+			cluster.first_index = (GLuint) first;
+			cluster.index_count = 0;
+			cluster_number++;
+			cluster_vertices = 0;
+		}
+		for (int c = 0; c < 3; c++) {
+			GLuint v = indices[first + c];
+			if (vertex_cluster[v] != cluster_number) {
+				vertex_cluster[v] = cluster_number;
+				cluster_vertices++;
+			}
+		}
+		cluster.index_count += 3;
+	}
+	computeClusterBounds(geom_node, cluster);
+	geom_node->clusters.push_back(cluster);
+}
+
+void extractFrustumPlanes(const glm::mat4& clip, float planes[6][4]) {
+	for (int i = 0; i < 3; i++) {
+		for (int k = 0; k < 4; k++) {
+			planes[2 * i][k] = clip[k][3] + clip[k][i];
+			planes[2 * i + 1][k] = clip[k][3] - clip[k][i];
+		}
+	}
+	for (int p = 0; p < 6; p++) {
+		float length = sqrtf(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+		if (length > 0.f) {
+			for (int k = 0; k < 4; k++) {
+				planes[p][k] /= length;
+			}
+		}
+	}
+}
+
+bool sphereInFrustum(const float planes[6][4], const float center[3], float radius) {
+	for (int p = 0; p < 6; p++) {
+		float distance = planes[p][0] * center[0] + planes[p][1] * center[1] + planes[p][2] * center[2] + planes[p][3];
+		if (distance < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void visibleIndexRanges(const GeometryNode& geom_node, size_t level, const glm::mat4& model_matrix,
+		const Camera& camera, std::vector<IndexRange>& ranges) {
+	ranges.clear();
+	LodLevel lod = geom_node.lod(level);
+	if (lod.index_count == 0) {
+		return;
+	}
+	// Everything is tested in object space
+	glm::mat4 modelview = camera.modelview_matrix * model_matrix;
+	float planes[6][4];
+	extractFrustumPlanes(camera.projection_matrix * modelview, planes);
+	if (!sphereInFrustum(planes, geom_node.sphere_center, geom_node.radius)) {
+		return;
+	}
+	if (level != 0 || geom_node.clusters.empty()) {
+		IndexRange range = { lod.first_index, lod.index_count };
+		ranges.push_back(range);
+		return;
+	}
+	for (size_t c = 0; c < geom_node.clusters.size(); c++) {
+		const MeshCluster& cluster = geom_node.clusters[c];
+		if (!sphereInFrustum(planes, cluster.center, cluster.radius)) {
+			continue;
+		}
+		if (!ranges.empty() && ranges.back().first_index + ranges.back().index_count == cluster.first_index) {
+			ranges.back().index_count += cluster.index_count;
+		} else {
+			IndexRange range = { cluster.first_index, cluster.index_count };
+			ranges.push_back(range);
+		}
+	}
+}
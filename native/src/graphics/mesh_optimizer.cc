@@ -0,0 +1,328 @@
+// Copyright (C) 2017 Chris Liebert
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "graphics/mesh_optimizer.h"
+
+using scenegraph::Vertex;
+
+VertexCacheStatistics::VertexCacheStatistics() {
+	triangles = 0;
+	vertices = 0;
+	misses = 0;
+}
+
+void VertexCacheStatistics::add(const VertexCacheStatistics& other) {
+	triangles += other.triangles;
+	vertices += other.vertices;
+	misses += other.misses;
+}
+
+float VertexCacheStatistics::acmr() const {
+	return triangles ? (float) misses / (float) triangles : 0.f;
+}
+
+float VertexCacheStatistics::atvr() const {
+	return vertices ? (float) misses / (float) vertices : 0.f;
+}
+
+void analyzeVertexCache(const std::vector<GLuint>& indices, size_t vertex_count,
+		VertexCacheStatistics& statistics) {
+	// A vertex is in the FIFO cache while fewer than the cache size misses happened after it was loaded
+	std::vector<size_t> loaded_at(vertex_count, 0);
+	size_t misses = 0;
+	size_t num_indices = indices.size() - indices.size() % 3;
+	for (size_t i = 0; i < num_indices; i++) {
+		GLuint v = indices[i];
+		assert(v < vertex_count);
+		if (loaded_at[v] == 0 || misses - loaded_at[v] >= VERTEX_CACHE_ANALYZE_SIZE) {
+			misses++;
+			loaded_at[v] = misses;
+		}
+	}
+	statistics.triangles = num_indices / 3;
+	statistics.vertices = vertex_count;
+	statistics.misses = misses;
+}
+
+// Vertex scores from the cache position and the number of triangles still using the vertex
+#define FORSYTH_MAX_VALENCE 32
+
+static float cache_position_scores[VERTEX_CACHE_OPTIMIZE_SIZE];
+static float valence_scores[FORSYTH_MAX_VALENCE];
+
+static bool initScoreTables() {
+	const float cache_decay_power = 1.5f;
+	const float last_triangle_score = 0.75f;
+	const float valence_boost_scale = 2.0f;
+	const float valence_boost_power = 0.5f;
+	for (int i = 0; i < VERTEX_CACHE_OPTIMIZE_SIZE; i++) {
+		if (i < 3) {
+			// The vertices of the last triangle are scored low so it is not simply repeated
+			cache_position_scores[i] = last_triangle_score;
+		} else {
+			float scaler = 1.f / (float) (VERTEX_CACHE_OPTIMIZE_SIZE - 3);
+			cache_position_scores[i] = powf(1.f - (float) (i - 3) * scaler, cache_decay_power);
+		}
+	}
+	valence_scores[0] = 0.f;
+	for (int i = 1; i < FORSYTH_MAX_VALENCE; i++) {
+		// Vertices with few remaining triangles are finished first
+		valence_scores[i] = valence_boost_scale * powf((float) i, -valence_boost_power);
+	}
+	return true;
+}
+
+static float vertexScore(int cache_position, unsigned remaining_triangles) {
+	if (remaining_triangles == 0) {
+		return -1.f;
+	}
+	float score = cache_position >= 0 ? cache_position_scores[cache_position] : 0.f;
+	if (remaining_triangles < FORSYTH_MAX_VALENCE) {
+		score += valence_scores[remaining_triangles];
+	} else {
+		score += 2.0f * powf((float) remaining_triangles, -0.5f);
+	}
+	return score;
+}
+
+void optimizeVertexCache(std::vector<GLuint>& indices, size_t vertex_count) {
+	static const bool tables_ready = initScoreTables();
+	(void) tables_ready;
+	size_t num_triangles = indices.size() / 3;
+	if (num_triangles < 2 || vertex_count == 0) {
+		return;
+	}
+
+	// Triangles using each vertex, the first remaining[v] entries are the ones not yet emitted
+	std::vector<unsigned> remaining(vertex_count, 0);
+	for (size_t i = 0; i < num_triangles * 3; i++) {
+		remaining[indices[i]]++;
+	}
+	std::vector<size_t> adjacency_offsets(vertex_count + 1, 0);
+	for (size_t v = 0; v < vertex_count; v++) {
+		adjacency_offsets[v + 1] = adjacency_offsets[v] + remaining[v];
+	}
+	std::vector<GLuint> adjacency(num_triangles * 3);
+	{
+		std::vector<size_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+		for (size_t t = 0; t < num_triangles; t++) {
+			for (int c = 0; c < 3; c++) {
+				adjacency[fill[indices[3 * t + c]]++] = (GLuint) t;
+			}
+		}
+	}
+
+	std::vector<float> vertex_scores(vertex_count);
+	for (size_t v = 0; v < vertex_count; v++) {
+		vertex_scores[v] = vertexScore(-1, remaining[v]);
+	}
+	std::vector<bool> emitted(num_triangles, false);
+	size_t best_triangle = 0;
+	float best_score = -1.f;
+	for (size_t t = 0; t < num_triangles; t++) {
+		float score = vertex_scores[indices[3 * t]] + vertex_scores[indices[3 * t + 1]]
+				+ vertex_scores[indices[3 * t + 2]];
+		if (score > best_score) {
+			best_score = score;
+			best_triangle = t;
+		}
+	}
+
+	std::vector<GLuint> output;
+	output.reserve(num_triangles * 3);
+	std::vector<GLuint> cache, next_cache;
+	cache.reserve(VERTEX_CACHE_OPTIMIZE_SIZE + 3);
+	next_cache.reserve(VERTEX_CACHE_OPTIMIZE_SIZE + 3);
+	size_t next_unemitted = 0;
+	bool have_best = true;
+
+	for (size_t n = 0; n < num_triangles; n++) {
+		if (!have_best) {
+			// Nothing in the cache is connected to a remaining triangle, continue in input order
+			while (emitted[next_unemitted]) {
+				next_unemitted++;
+			}
+			best_triangle = next_unemitted;
+		}
+		emitted[best_triangle] = true;
+		const GLuint* triangle = &indices[3 * best_triangle];
+		next_cache.clear();
+		for (int c = 0; c < 3; c++) {
+			GLuint v = triangle[c];
+			output.push_back(v);
+			// Remove the triangle from the remaining triangles of v
+			size_t begin = adjacency_offsets[v];
+			size_t last = begin + remaining[v] - 1;
+			for (size_t a = begin; a <= last; a++) {
+				if (adjacency[a] == best_triangle) {
+					std::swap(adjacency[a], adjacency[last]);
+					break;
+				}
+			}
+			remaining[v]--;
+			if (std::find(next_cache.begin(), next_cache.end(), v) == next_cache.end()) {
+				next_cache.push_back(v);
+			}
+		}
+		for (size_t i = 0; i < cache.size(); i++) {
+			GLuint v = cache[i];
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+				next_cache.push_back(v);
+			}
+		}
+		// Vertices pushed out of the cache lose their cache score
+		for (size_t i = VERTEX_CACHE_OPTIMIZE_SIZE; i < next_cache.size(); i++) {
+			GLuint v = next_cache[i];
+			vertex_scores[v] = vertexScore(-1, remaining[v]);
+		}
+		if (next_cache.size() > VERTEX_CACHE_OPTIMIZE_SIZE) {
+			next_cache.resize(VERTEX_CACHE_OPTIMIZE_SIZE);
+		}
+		cache.swap(next_cache);
+		for (size_t i = 0; i < cache.size(); i++) {
+			GLuint v = cache[i];
+			vertex_scores[v] = vertexScore((int) i, remaining[v]);
+		}
+
+		// Only triangles touching the cache changed their score
+		have_best = false;
+		best_score = -1.f;
+		for (size_t i = 0; i < cache.size(); i++) {
+			GLuint v = cache[i];
+			size_t begin = adjacency_offsets[v];
+			for (size_t a = begin; a < begin + remaining[v]; a++) {
+				GLuint t = adjacency[a];
+				float score = vertex_scores[indices[3 * t]] + vertex_scores[indices[3 * t + 1]]
+						+ vertex_scores[indices[3 * t + 2]];
+				if (score > best_score) {
+					best_score = score;
+					best_triangle = t;
+					have_best = true;
+				}
+			}
+		}
+	}
+	indices.swap(output);
+}
+
+typedef struct TriangleCluster {
+	size_t first_triangle;
+	size_t num_triangles;
+	float sort_key;
+} TriangleCluster;
+
+static bool outerClusterFirst(const TriangleCluster& a, const TriangleCluster& b) {
+	return a.sort_key > b.sort_key;
+}
+
+void optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<Vertex>& vertices) {
+	size_t num_triangles = indices.size() / 3;
+	if (num_triangles < 2) {
+		return;
+	}
+
+	// Simulate the cache to find where the triangle order starts over (all three vertices missed)
+	// and the miss rate of the whole mesh
+	std::vector<unsigned char> triangle_misses(num_triangles);
+	std::vector<size_t> loaded_at(vertices.size(), 0);
+	size_t misses = 0;
+	for (size_t t = 0; t < num_triangles; t++) {
+		unsigned char triangle_miss_count = 0;
+		for (int c = 0; c < 3; c++) {
+			GLuint v = indices[3 * t + c];
+			if (loaded_at[v] == 0 || misses - loaded_at[v] >= VERTEX_CACHE_ANALYZE_SIZE) {
+				misses++;
+				loaded_at[v] = misses;
+				triangle_miss_count++;
+			}
+		}
+		triangle_misses[t] = triangle_miss_count;
+	}
+	float mesh_acmr = (float) misses / (float) num_triangles;
+
+	std::vector<TriangleCluster> clusters;
+	size_t cluster_misses = 0;
+	for (size_t t = 0; t < num_triangles; t++) {
+		bool hard_boundary = t == 0 || triangle_misses[t] == 3;
+		bool soft_boundary = false;
+		if (!hard_boundary) {
+			// Splitting here keeps the cache efficiency of the triangles before t
+			const TriangleCluster& current = clusters.back();
+			float cluster_acmr = (float) cluster_misses / (float) current.num_triangles;
+			soft_boundary = cluster_acmr <= mesh_acmr * OVERDRAW_CACHE_THRESHOLD
+					&& triangle_misses[t] > 1;
+		}
+		if (hard_boundary || soft_boundary) {
+			TriangleCluster cluster;
+			cluster.first_triangle = t;
+			cluster.num_triangles = 0;
+			cluster.sort_key = 0.f;
+			clusters.push_back(cluster);
+			cluster_misses = 0;
+		}
+		clusters.back().num_triangles++;
+		cluster_misses += triangle_misses[t];
+	}
+	if (clusters.size() < 2) {
+		return;
+	}
+
+	// Area weighted centroids and normals
+	std::vector<glm::vec3> cluster_centroids(clusters.size());
+	std::vector<glm::vec3> cluster_normals(clusters.size());
+	glm::vec3 mesh_centroid(0.f);
+	float mesh_area = 0.f;
+	for (size_t c = 0; c < clusters.size(); c++) {
+		glm::vec3 centroid(0.f), normal(0.f);
+		float area = 0.f;
+		for (size_t t = clusters[c].first_triangle; t < clusters[c].first_triangle + clusters[c].num_triangles; t++) {
+			glm::vec3 p0 = glm::make_vec3(vertices[indices[3 * t]].position);
+			glm::vec3 p1 = glm::make_vec3(vertices[indices[3 * t + 1]].position);
+			glm::vec3 p2 = glm::make_vec3(vertices[indices[3 * t + 2]].position);
+			glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+			float triangle_area = glm::length(cross);
+			centroid += (p0 + p1 + p2) * (triangle_area / 3.f);
+			normal += cross;
+			area += triangle_area;
+		}
+		mesh_centroid += centroid;
+		mesh_area += area;
+		cluster_centroids[c] = area > 0.f ? centroid / area : centroid;
+		float normal_length = glm::length(normal);
+		cluster_normals[c] = normal_length > 0.f ? normal / normal_length : normal;
+	}
+	if (mesh_area > 0.f) {
+		mesh_centroid /= mesh_area;
+	}
+	for (size_t c = 0; c < clusters.size(); c++) {
+		clusters[c].sort_key = glm::dot(cluster_centroids[c] - mesh_centroid, cluster_normals[c]);
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), outerClusterFirst);
+
+	std::vector<GLuint> output;
+	output.reserve(num_triangles * 3);
+	for (size_t c = 0; c < clusters.size(); c++) {
+		std::vector<GLuint>::const_iterator first = indices.begin() + 3 * clusters[c].first_triangle;
+		output.insert(output.end(), first, first + 3 * clusters[c].num_triangles);
+	}
+	indices.swap(output);
+}
+
+void optimizeVertexFetch(std::vector<GLuint>& indices, std::vector<Vertex>& vertices) {
+	const GLuint unused = 0xFFFFFFFFu;
+	std::vector<GLuint> remap(vertices.size(), unused);
+	std::vector<Vertex> ordered;
+	ordered.reserve(vertices.size());
+	for (size_t i = 0; i < indices.size(); i++) {
+		GLuint v = indices[i];
+		if (remap[v] == unused) {
+			remap[v] = (GLuint) ordered.size();
+			ordered.push_back(vertices[v]);
+		}
+		indices[i] = remap[v];
+	}
+	vertices.swap(ordered);
+}
@@ -0,0 +1,493 @@
+// Copyright (C) 2017 Chris Liebert
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "common/flat_index_map.hpp"
+#include "common/hash.hpp"
+#include "graphics/mesh_optimizer.h"
+#include "graphics/mesh_simplifier.h"
+
+using scenegraph::Vertex;
+using scenegraph::GeometryNode;
+using scenegraph::LodLevel;
+using scenegraph::SubMesh;
+
+// Sum of squared distances to a set of planes ax + by + cz + d = 0, weighted by triangle area
+typedef struct Quadric {
+	double a2, b2, c2, ab, ac, bc, ad, bd, cd, d2;
+	double weight;
+} Quadric;
+
+static void quadricAddPlane(Quadric& q, double a, double b, double c, double d, double w) {
+	q.a2 += w * a * a;
+	q.b2 += w * b * b;
+	q.c2 += w * c * c;
+	q.ab += w * a * b;
+	q.ac += w * a * c;
+	q.bc += w * b * c;
+	q.ad += w * a * d;
+	q.bd += w * b * d;
+	q.cd += w * c * d;
+	q.d2 += w * d * d;
+	q.weight += w;
+}
+
+static void quadricAdd(Quadric& q, const Quadric& other) {
+	q.a2 += other.a2;
+	q.b2 += other.b2;
+	q.c2 += other.c2;
+	q.ab += other.ab;
+	q.ac += other.ac;
+	q.bc += other.bc;
+	q.ad += other.ad;
+	q.bd += other.bd;
+	q.cd += other.cd;
+	q.d2 += other.d2;
+	q.weight += other.weight;
+}
+
+static double quadricError(const Quadric& q, const float p[3]) {
+	double x = p[0], y = p[1], z = p[2];
+	double error = q.a2 * x * x + q.b2 * y * y + q.c2 * z * z
+			+ 2.0 * (q.ab * x * y + q.ac * x * z + q.bc * y * z)
+			+ 2.0 * (q.ad * x + q.bd * y + q.cd * z) + q.d2;
+	return error > 0.0 ? error : 0.0;
+}
+
+typedef struct Position {
+	float xyz[3];
+} Position;
+
+struct PositionHash {
+	uint64_t operator()(const Position& position) const {
+		return murmur64(position.xyz, sizeof(position.xyz));
+	}
+};
+
+struct PositionEqual {
+	bool operator()(const Position& a, const Position& b) const {
+		return 0 == memcmp(a.xyz, b.xyz, sizeof(a.xyz));
+	}
+};
+
+struct EdgeHash {
+	uint64_t operator()(uint64_t edge) const {
+		return mix64(edge);
+	}
+};
+
+struct EdgeEqual {
+	bool operator()(uint64_t a, uint64_t b) const {
+		return a == b;
+	}
+};
+
+static inline uint64_t edgeKey(GLuint a, GLuint b) {
+	return a < b ? ((uint64_t) a << 32) | b : ((uint64_t) b << 32) | a;
+}
+
+typedef struct Collapse {
+	GLuint from;
+	GLuint to;
+	double cost;
+} Collapse;
+
+static bool cheaperCollapse(const Collapse& a, const Collapse& b) {
+	return a.cost < b.cost;
+}
+
+static void triangleNormal(const float* p0, const float* p1, const float* p2, float normal[3]) {
+	float e1[3], e2[3];
+	for (int k = 0; k < 3; k++) {
+		e1[k] = p1[k] - p0[k];
+		e2[k] = p2[k] - p0[k];
+	}
+	normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// State of one simplification, positions are the topology and vertices carry the attributes
+class EdgeCollapser {
+public:
+	std::vector<GLuint>& triangles;
+	const std::vector<Position>& positions;
+	const std::vector<GLuint>& position_of;
+	std::vector<bool> live;
+	std::vector<size_t> adjacency_offsets;
+	std::vector<GLuint> adjacency;
+
+	EdgeCollapser(std::vector<GLuint>& _triangles, const std::vector<Position>& _positions,
+			const std::vector<GLuint>& _position_of)
+	: triangles(_triangles), positions(_positions), position_of(_position_of) {
+	}
+
+	GLuint position(size_t triangle, int corner) const {
+		return position_of[triangles[3 * triangle + corner]];
+	}
+
+	// Rebuilds the live triangles around each position
+	void buildAdjacency() {
+		size_t num_positions = positions.size();
+		adjacency_offsets.assign(num_positions + 1, 0);
+		for (size_t t = 0; t < live.size(); t++) {
+			if (live[t]) {
+				for (int c = 0; c < 3; c++) {
+					adjacency_offsets[position(t, c) + 1]++;
+				}
+			}
+		}
+		for (size_t p = 0; p < num_positions; p++) {
+			adjacency_offsets[p + 1] += adjacency_offsets[p];
+		}
+		adjacency.resize(adjacency_offsets[num_positions]);
+		std::vector<size_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+		for (size_t t = 0; t < live.size(); t++) {
+			if (live[t]) {
+				for (int c = 0; c < 3; c++) {
+					adjacency[fill[position(t, c)]++] = (GLuint) t;
+				}
+			}
+		}
+	}
+
+	void collectNeighbors(GLuint p, std::vector<GLuint>& neighbors) const {
+		neighbors.clear();
+		for (size_t a = adjacency_offsets[p]; a < adjacency_offsets[p + 1]; a++) {
+			GLuint t = adjacency[a];
+			if (!live[t]) {
+				continue;
+			}
+			for (int c = 0; c < 3; c++) {
+				if (position(t, c) != p) {
+					neighbors.push_back(position(t, c));
+				}
+			}
+		}
+		std::sort(neighbors.begin(), neighbors.end());
+		neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+	}
+
+	// Checks that moving from onto to keeps the surface manifold without flipping triangles,
+	// target_vertex is the vertex at to that replaces the vertex at from
+	bool canCollapse(GLuint from, GLuint to, GLuint& target_vertex,
+			std::vector<GLuint>& from_neighbors, std::vector<GLuint>& to_neighbors) const {
+		size_t shared_triangles = 0;
+		for (size_t a = adjacency_offsets[from]; a < adjacency_offsets[from + 1]; a++) {
+			GLuint t = adjacency[a];
+			if (!live[t]) {
+				continue;
+			}
+			int from_corner = -1, to_corner = -1;
+			for (int c = 0; c < 3; c++) {
+				GLuint p = position(t, c);
+				if (p == from) {
+					from_corner = c;
+				} else if (p == to) {
+					to_corner = c;
+				}
+			}
+			if (to_corner >= 0) {
+				// The triangles on the edge must agree on the attributes at to
+				GLuint vertex = triangles[3 * t + to_corner];
+				if (shared_triangles > 0 && vertex != target_vertex) {
+					return false;
+				}
+				target_vertex = vertex;
+				shared_triangles++;
+				continue;
+			}
+			const float* p[3];
+			for (int c = 0; c < 3; c++) {
+				p[c] = positions[position(t, c)].xyz;
+			}
+			float before[3], after[3];
+			triangleNormal(p[0], p[1], p[2], before);
+			p[from_corner] = positions[to].xyz;
+			triangleNormal(p[0], p[1], p[2], after);
+			// Rotating a triangle by more than about 75 degrees is treated as a flip
+			float dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+			float before_length = sqrtf(before[0] * before[0] + before[1] * before[1] + before[2] * before[2]);
+			float after_length = sqrtf(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+			if (dot <= 0.25f * before_length * after_length) {
+				return false;
+			}
+		}
+		if (shared_triangles == 0) {
+			// An earlier collapse in this pass removed the edge
+			return false;
+		}
+		// Only the vertices opposite the edge may be neighbors of both ends
+		collectNeighbors(from, from_neighbors);
+		collectNeighbors(to, to_neighbors);
+		size_t common = 0;
+		std::vector<GLuint>::const_iterator a = from_neighbors.begin(), b = to_neighbors.begin();
+		while (a != from_neighbors.end() && b != to_neighbors.end()) {
+			if (*a < *b) {
+				++a;
+			} else if (*b < *a) {
+				++b;
+			} else {
+				common++;
+				++a;
+				++b;
+			}
+		}
+		return common == shared_triangles;
+	}
+
+	// Moves the triangles around from onto target_vertex, returns the number of triangles removed
+	size_t collapse(GLuint from, GLuint to, GLuint target_vertex) {
+		size_t removed = 0;
+		for (size_t a = adjacency_offsets[from]; a < adjacency_offsets[from + 1]; a++) {
+			GLuint t = adjacency[a];
+			if (!live[t]) {
+				continue;
+			}
+			bool degenerate = false;
+			for (int c = 0; c < 3; c++) {
+				GLuint p = position(t, c);
+				if (p == to) {
+					degenerate = true;
+				} else if (p == from) {
+					triangles[3 * t + c] = target_vertex;
+				}
+			}
+			if (degenerate) {
+				live[t] = false;
+				removed++;
+			}
+		}
+		return removed;
+	}
+};
+
+float simplifyMesh(const std::vector<GLuint>& indices, const std::vector<Vertex>& vertices,
+		size_t target_index_count, std::vector<GLuint>& result) {
+	result.assign(indices.begin(), indices.end() - indices.size() % 3);
+	size_t num_triangles = result.size() / 3;
+	if (result.size() <= target_index_count || num_triangles == 0) {
+		return 0.f;
+	}
+
+	// Vertices split by normals or texture coordinates share a position, the topology is built on positions
+	std::vector<GLuint> position_of(vertices.size());
+	FlatIndexMap<Position, PositionHash, PositionEqual> position_map(vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++) {
+		Position position;
+		memcpy(position.xyz, vertices[v].position, sizeof(position.xyz));
+		bool inserted;
+		position_of[v] = position_map.insert(position, inserted);
+	}
+	const std::vector<Position>& positions = position_map.getKeys();
+	size_t num_positions = positions.size();
+
+	// A position used through more than one vertex is on an attribute seam and is kept
+	std::vector<GLuint> position_vertex(num_positions, FLAT_INDEX_MAP_EMPTY_SLOT);
+	std::vector<bool> locked(num_positions, false);
+	for (size_t i = 0; i < result.size(); i++) {
+		GLuint p = position_of[result[i]];
+		if (position_vertex[p] == FLAT_INDEX_MAP_EMPTY_SLOT) {
+			position_vertex[p] = result[i];
+		} else if (position_vertex[p] != result[i]) {
+			locked[p] = true;
+		}
+	}
+
+	EdgeCollapser collapser(result, positions, position_of);
+	collapser.live.assign(num_triangles, true);
+	size_t live_triangles = num_triangles;
+
+	// Open borders and non-manifold edges are kept, the quadrics describe the input surface
+	FlatIndexMap<uint64_t, EdgeHash, EdgeEqual> edges(result.size());
+	std::vector<unsigned> edge_uses;
+	Quadric zero;
+	memset(&zero, 0, sizeof(zero));
+	std::vector<Quadric> quadrics(num_positions, zero);
+	for (size_t t = 0; t < num_triangles; t++) {
+		GLuint p[3];
+		for (int c = 0; c < 3; c++) {
+			p[c] = collapser.position(t, c);
+		}
+		if (p[0] == p[1] || p[1] == p[2] || p[0] == p[2]) {
+			collapser.live[t] = false;
+			live_triangles--;
+			continue;
+		}
+		for (int c = 0; c < 3; c++) {
+			bool inserted;
+			uint32_t edge = edges.insert(edgeKey(p[c], p[(c + 1) % 3]), inserted);
+			if (inserted) {
+				edge_uses.push_back(0);
+			}
+			edge_uses[edge]++;
+		}
+		float normal[3];
+		triangleNormal(positions[p[0]].xyz, positions[p[1]].xyz, positions[p[2]].xyz, normal);
+		double length = sqrt((double) normal[0] * normal[0] + (double) normal[1] * normal[1]
+				+ (double) normal[2] * normal[2]);
+		if (length <= 0.0) {
+			continue;
+		}
+		double a = normal[0] / length, b = normal[1] / length, c = normal[2] / length;
+		const float* p0 = positions[p[0]].xyz;
+		double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+		for (int k = 0; k < 3; k++) {
+			quadricAddPlane(quadrics[p[k]], a, b, c, d, length * 0.5);
+		}
+	}
+	const std::vector<uint64_t>& edge_keys = edges.getKeys();
+	for (size_t e = 0; e < edge_keys.size(); e++) {
+		if (edge_uses[e] != 2) {
+			locked[(GLuint) (edge_keys[e] >> 32)] = true;
+			locked[(GLuint) (edge_keys[e] & 0xFFFFFFFFu)] = true;
+		}
+	}
+
+	size_t target_triangles = target_index_count / 3;
+	double max_error = 0.0;
+	std::vector<Collapse> collapses;
+	std::vector<double> best_cost;
+	std::vector<GLuint> best_target;
+	std::vector<bool> touched;
+	std::vector<GLuint> from_neighbors, to_neighbors;
+	while (live_triangles > target_triangles) {
+		collapser.buildAdjacency();
+
+		// The cheapest collapse of every position that may move
+		best_cost.assign(num_positions, std::numeric_limits<double>::max());
+		best_target.assign(num_positions, 0);
+		for (size_t t = 0; t < num_triangles; t++) {
+			if (!collapser.live[t]) {
+				continue;
+			}
+			for (int c = 0; c < 3; c++) {
+				GLuint ends[2] = { collapser.position(t, c), collapser.position(t, (c + 1) % 3) };
+				for (int direction = 0; direction < 2; direction++) {
+					GLuint from = ends[direction], to = ends[1 - direction];
+					if (locked[from]) {
+						continue;
+					}
+					double cost = quadricError(quadrics[from], positions[to].xyz);
+					if (cost < best_cost[from]) {
+						best_cost[from] = cost;
+						best_target[from] = to;
+					}
+				}
+			}
+		}
+		collapses.clear();
+		for (size_t p = 0; p < num_positions; p++) {
+			if (best_cost[p] < std::numeric_limits<double>::max()) {
+				Collapse collapse = { (GLuint) p, best_target[p], best_cost[p] };
+				collapses.push_back(collapse);
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), cheaperCollapse);
+
+		// Each position changes at most once per pass, so the costs of the other collapses stay valid
+		touched.assign(num_positions, false);
+		size_t applied = 0;
+		for (size_t i = 0; i < collapses.size() && live_triangles > target_triangles; i++) {
+			const Collapse& collapse = collapses[i];
+			if (touched[collapse.from] || touched[collapse.to]) {
+				continue;
+			}
+			GLuint target_vertex = 0;
+			if (!collapser.canCollapse(collapse.from, collapse.to, target_vertex, from_neighbors, to_neighbors)) {
+				continue;
+			}
+			live_triangles -= collapser.collapse(collapse.from, collapse.to, target_vertex);
+			const Quadric& from_quadric = quadrics[collapse.from];
+			if (from_quadric.weight > 0.0) {
+				max_error = std::max(max_error, collapse.cost / from_quadric.weight);
+			}
+			quadricAdd(quadrics[collapse.to], from_quadric);
+			touched[collapse.from] = true;
+			touched[collapse.to] = true;
+			applied++;
+		}
+		if (applied == 0) {
+			break;
+		}
+	}
+
+	size_t written = 0;
+	for (size_t t = 0; t < num_triangles; t++) {
+		if (collapser.live[t]) {
+			for (int c = 0; c < 3; c++) {
+				result[written++] = result[3 * t + c];
+			}
+		}
+	}
+	result.resize(written);
+	return (float) sqrt(max_error);
+}
+
+void generateLods(GeometryNode* geom_node) {
+	geom_node->lods.clear();
+	LodLevel full_detail;
+	full_detail.first_index = 0;
+	full_detail.index_count = (GLuint) geom_node->index_data.size();
+	full_detail.error = 0.f;
+	geom_node->lods.push_back(full_detail);
+
+	// Submeshes are simplified separately, their shared edges are borders and stay in place
+	std::vector<SubMesh> full_detail_submeshes(geom_node->submeshes);
+	if (full_detail_submeshes.empty()) {
+		SubMesh whole = { 0, 0, full_detail.index_count };
+		full_detail_submeshes.push_back(whole);
+	}
+	size_t num_submeshes = full_detail_submeshes.size();
+	std::vector<std::vector<GLuint> > previous(num_submeshes);
+	std::vector<float> errors(num_submeshes, 0.f);
+	size_t previous_count = full_detail.index_count;
+	for (size_t m = 0; m < num_submeshes; m++) {
+		std::vector<GLuint>::const_iterator first = geom_node->index_data.begin() + full_detail_submeshes[m].first_index;
+		previous[m].assign(first, first + full_detail_submeshes[m].index_count);
+	}
+	std::vector<std::vector<GLuint> > simplified(num_submeshes);
+	for (int level = 1; level < MESH_LOD_LEVELS; level++) {
+		size_t simplified_count = 0;
+		float error = 0.f;
+		for (size_t m = 0; m < num_submeshes; m++) {
+			size_t target = (size_t) ((float) (previous[m].size() / 3) * MESH_LOD_REDUCTION) * 3;
+			// Each level is simplified from the previous one, so the errors add up
+			float submesh_error = errors[m];
+			if (!previous[m].empty()) {
+				submesh_error += simplifyMesh(previous[m], geom_node->vertex_data, target, simplified[m]);
+			} else {
+				simplified[m].clear();
+			}
+			simplified_count += simplified[m].size();
+			error = std::max(error, submesh_error);
+			errors[m] = submesh_error;
+		}
+		if (simplified_count == 0 || (float) simplified_count > (float) previous_count * MESH_LOD_MIN_REDUCTION) {
+			break;
+		}
+		LodLevel lod;
+		lod.first_index = (GLuint) geom_node->index_data.size();
+		lod.index_count = (GLuint) simplified_count;
+		lod.error = error;
+		for (size_t m = 0; m < num_submeshes; m++) {
+			optimizeVertexCache(simplified[m], geom_node->vertex_data.size());
+			if (!geom_node->submeshes.empty() && !simplified[m].empty()) {
+				SubMesh submesh = { full_detail_submeshes[m].material, (GLuint) geom_node->index_data.size(),
+						(GLuint) simplified[m].size() };
+				geom_node->submeshes.push_back(submesh);
+			}
+			geom_node->index_data.insert(geom_node->index_data.end(), simplified[m].begin(), simplified[m].end());
+			previous[m].swap(simplified[m]);
+		}
+		geom_node->lods.push_back(lod);
+		previous_count = simplified_count;
+	}
+	if (geom_node->lods.size() == 1) {
+		// Nothing could be simplified, the node draws all of its indices
+		geom_node->lods.clear();
+	}
+}
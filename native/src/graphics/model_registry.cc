@@ -0,0 +1,159 @@
+// Copyright (C) 2017 Chris Liebert
+
+#include "graphics/model_registry.h"
+#include "graphics/gltf_factory.h"
+#include "graphics/wavefront_factory.h"
+#include "common/log.h"
+
+using namespace scenegraph;
+
+ModelRegistry::ModelRegistry(const std::string& cache_directory, ThreadPool* pool, VertexFormat vertex_format,
+		SceneArena* arena)
+: cache_directory(cache_directory), pool(pool), vertex_format(vertex_format), arena(arena) {
+}
+
+ModelRegistry::~ModelRegistry() {
+	// Releasing the arena frees the models without walking them
+	if (arena) {
+		models.clear();
+		return;
+	}
+	for (std::map<std::string, Node*>::iterator it = models.begin(); it != models.end(); ++it) {
+		scenegraph::destroy(it->second);
+	}
+	models.clear();
+}
+
+Node* ModelRegistry::find(const char* filename) {
+	std::map<std::string, Node*>::iterator it = models.find(filename);
+	if (it == models.end()) {
+		return 0;
+	}
+	return instantiate(it->second);
+}
+
+static bool containsTransform(Node* node) {
+	if (node->type == Transform) {
+		return true;
+	}
+	for (std::vector<Node*>::iterator it = node->children.begin(); it != node->children.end(); ++it) {
+		if (containsTransform(*it)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// The geometry below the transforms is shared, the nodes above it are copied so that every
+// placement has transform handles of its own
+Node* ModelRegistry::instantiate(Node* model) {
+	if (!containsTransform(model)) {
+		return scenegraph::share(model);
+	}
+	Node* copy;
+	switch (model->type) {
+	case Material: {
+		MaterialNode* mat_node = createNode<MaterialNode>(arena);
+		mat_node->diffuse_texture = ((MaterialNode*) model)->diffuse_texture;
+		copy = mat_node;
+		break;
+	}
+	case Switch: {
+		SwitchNode* switch_node = createNode<SwitchNode>(arena);
+		switch_node->enabled = ((SwitchNode*) model)->enabled;
+		copy = switch_node;
+		break;
+	}
+	case Transform: {
+		TransformNode* trans_node = createNode<TransformNode>(arena);
+		trans_node->matrix = ((TransformNode*) model)->matrix;
+		copy = trans_node;
+		break;
+	}
+	default:
+		copy = createNode<Node>(arena);
+		break;
+	}
+	copy->name = model->name;
+	copy->num_children = model->num_children;
+	for (std::vector<Node*>::iterator it = model->children.begin(); it != model->children.end(); ++it) {
+		copy->children.push_back(instantiate(*it));
+	}
+	return copy;
+}
+
+// Counts how often the shared nodes occur in model, without entering them
+static void countShared(Node* model, std::map<Node*, size_t>& occurrences) {
+	if (!containsTransform(model)) {
+		occurrences[model]++;
+		return;
+	}
+	for (std::vector<Node*>::iterator it = model->children.begin(); it != model->children.end(); ++it) {
+		countShared(*it, occurrences);
+	}
+}
+
+// Placements hold references to the shared nodes beyond those held by the model
+static bool isPlaced(Node* model) {
+	std::map<Node*, size_t> occurrences;
+	countShared(model, occurrences);
+	for (std::map<Node*, size_t>::iterator it = occurrences.begin(); it != occurrences.end(); ++it) {
+		if (it->first->references > it->second) {
+			return true;
+		}
+	}
+	return false;
+}
+
+Node* ModelRegistry::acquireWavefront(const char* filename, AssetManager* asset_manager,
+		std::set<std::string>& textures) {
+	Node* model = find(filename);
+	if (model) {
+		return model;
+	}
+	WavefrontSceneGraphFactory factory(cache_directory, pool, arena);
+	factory.vertex_format = vertex_format;
+	if (!factory.addWavefront(filename, glm::mat4(1.f), asset_manager)) {
+		return 0;
+	}
+	textures.insert(factory.textures.begin(), factory.textures.end());
+	model = factory.build();
+	assert(model);
+	models[filename] = model;
+	return instantiate(model);
+}
+
+Node* ModelRegistry::acquireGltf(const char* filename, AssetManager* asset_manager,
+		std::set<std::string>& textures) {
+	Node* model = find(filename);
+	if (model) {
+		return model;
+	}
+	GltfSceneGraphFactory factory(arena);
+	factory.vertex_format = vertex_format;
+	if (!factory.addGltf(filename, glm::mat4(1.f), asset_manager)) {
+		return 0;
+	}
+	textures.insert(factory.textures.begin(), factory.textures.end());
+	model = factory.build();
+	assert(model);
+	models[filename] = model;
+	return instantiate(model);
+}
+
+void ModelRegistry::releaseUnused() {
+	std::map<std::string, Node*>::iterator it = models.begin();
+	while (it != models.end()) {
+		if (!isPlaced(it->second)) {
+			LOGI("Releasing unused model %s", it->first.c_str());
+			scenegraph::destroy(it->second);
+			models.erase(it++);
+		} else {
+			++it;
+		}
+	}
+}
+
+size_t ModelRegistry::size() const {
+	return models.size();
+}
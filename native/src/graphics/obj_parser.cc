@@ -0,0 +1,722 @@
+// Copyright (C) 2017 Chris Liebert
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OBJ_PARSER_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define OBJ_PARSER_NEON 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "graphics/obj_parser.h"
+
+namespace wavefront {
+
+#if defined(OBJ_PARSER_SSE2) || defined(OBJ_PARSER_NEON)
+static inline unsigned countTrailingZeros(uint64_t mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+#if defined(_M_X64) || defined(_M_ARM64)
+	_BitScanForward64(&index, mask);
+#else
+	if (!_BitScanForward(&index, (unsigned long) mask)) {
+		_BitScanForward(&index, (unsigned long) (mask >> 32));
+		index += 32;
+	}
+#endif
+	return (unsigned) index;
+#else
+	return (unsigned) __builtin_ctzll(mask);
+#endif
+}
+#endif
+
+const char* findLineEnd(const char* p, const char* end) {
+#if defined(OBJ_PARSER_SSE2)
+	const __m128i newline = _mm_set1_epi8('\n');
+	while (end - p >= 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i*) p);
+		unsigned mask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+		if (mask) {
+			return p + countTrailingZeros(mask);
+		}
+		p += 16;
+	}
+#elif defined(OBJ_PARSER_NEON)
+	const uint8x16_t newline = vdupq_n_u8('\n');
+	while (end - p >= 16) {
+		uint8x16_t matches = vceqq_u8(vld1q_u8((const uint8_t*) p), newline);
+		// Narrow each byte of the comparison to 4 bits of a 64 bit mask
+		uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(matches), 4);
+		uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+		if (mask) {
+			return p + (countTrailingZeros(mask) >> 2);
+		}
+		p += 16;
+	}
+#endif
+	while (p < end && *p != '\n') {
+		p++;
+	}
+	return p;
+}
+
+static inline bool isSpace(char c) {
+	return c == ' ' || c == '\t';
+}
+
+static inline bool isDigit(char c) {
+	return (unsigned) (c - '0') < 10;
+}
+
+static inline void skipSpace(const char*& p, const char* end) {
+	while (p < end && isSpace(*p)) {
+		p++;
+	}
+}
+
+static inline void skipToken(const char*& p, const char* end) {
+	while (p < end && !isSpace(*p)) {
+		p++;
+	}
+}
+
+// Matches a keyword followed by whitespace or the end of the line and skips past it
+static inline bool keyword(const char*& p, const char* end, const char* word, size_t length) {
+	if ((size_t) (end - p) < length || memcmp(p, word, length) != 0) {
+		return false;
+	}
+	if (p + length < end && !isSpace(p[length])) {
+		return false;
+	}
+	p += length;
+	skipSpace(p, end);
+	return true;
+}
+
+// The remainder of a line without surrounding whitespace
+static inline std::string restOfLine(const char* p, const char* end) {
+	skipSpace(p, end);
+	while (end > p && isSpace(end[-1])) {
+		end--;
+	}
+	return std::string(p, end);
+}
+
+// Powers of ten that are exactly representable as a double
+static const double exact_powers_of_ten[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Numbers that cannot be converted exactly are handed to strtod
+static float parseFloatSlow(const char*& p, const char* start, const char* end) {
+	const char* token_end = start;
+	skipToken(token_end, end);
+	char buffer[64];
+	size_t length = (size_t) (token_end - start);
+	if (length >= sizeof(buffer)) {
+		length = sizeof(buffer) - 1;
+	}
+	memcpy(buffer, start, length);
+	buffer[length] = '\0';
+	char* parsed_end = buffer;
+	double value = strtod(buffer, &parsed_end);
+	p = token_end;
+	return (float) value;
+}
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define OBJ_PARSER_SWAR_DIGITS 1
+#endif
+
+#ifdef OBJ_PARSER_SWAR_DIGITS
+// Checks 8 characters at once for digits
+static inline bool isEightDigits(uint64_t chars) {
+	return (((chars + 0x4646464646464646ULL) | (chars - 0x3030303030303030ULL)) & 0x8080808080808080ULL) == 0;
+}
+
+// Converts 8 digits in a little endian word without a loop
+static inline uint32_t parseEightDigits(uint64_t chars) {
+	chars -= 0x3030303030303030ULL;
+	chars = (chars * 10) + (chars >> 8);
+	chars = (((chars & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32)))
+			+ (((chars >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+	return (uint32_t) chars;
+}
+#endif
+
+// Accumulates up to 19 digits into mantissa, returns the number of digits read
+static inline int parseDigits(const char*& p, const char* end, uint64_t& mantissa, int& num_digits, bool& truncated) {
+	const char* start = p;
+#ifdef OBJ_PARSER_SWAR_DIGITS
+	while (end - p >= 8 && num_digits <= 11) {
+		uint64_t chars;
+		memcpy(&chars, p, sizeof(chars));
+		if (!isEightDigits(chars)) {
+			break;
+		}
+		mantissa = mantissa * 100000000ULL + parseEightDigits(chars);
+		num_digits += 8;
+		p += 8;
+	}
+#endif
+	while (p < end && isDigit(*p)) {
+		if (num_digits < 19) {
+			mantissa = mantissa * 10 + (uint64_t) (*p - '0');
+			num_digits++;
+		} else if (*p != '0') {
+			truncated = true;
+		}
+		p++;
+	}
+	return (int) (p - start);
+}
+
+float parseFloat(const char*& p, const char* end) {
+	const char* start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		p++;
+	}
+	uint64_t mantissa = 0;
+	int num_digits = 0;
+	bool truncated = false;
+	int integer_digits = parseDigits(p, end, mantissa, num_digits, truncated);
+	// Integer digits past the 19th still scale the value
+	int exponent = integer_digits > num_digits ? integer_digits - num_digits : 0;
+	int fraction_digits = 0;
+	if (p < end && *p == '.') {
+		p++;
+		int stored_digits = num_digits;
+		fraction_digits = parseDigits(p, end, mantissa, num_digits, truncated);
+		exponent -= num_digits - stored_digits;
+	}
+	if (integer_digits + fraction_digits == 0) {
+		// nan, inf and malformed numbers
+		return parseFloatSlow(p, start, end);
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char* exponent_start = p;
+		p++;
+		bool negative_exponent = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative_exponent = (*p == '-');
+			p++;
+		}
+		if (p < end && isDigit(*p)) {
+			int e = 0;
+			while (p < end && isDigit(*p)) {
+				if (e < 10000) {
+					e = e * 10 + (*p - '0');
+				}
+				p++;
+			}
+			exponent += negative_exponent ? -e : e;
+		} else {
+			p = exponent_start;
+		}
+	}
+	if (truncated || mantissa > (1ULL << 53) || exponent < -22 || exponent > 22) {
+		return parseFloatSlow(p, start, end);
+	}
+	double value = (double) mantissa;
+	if (exponent < 0) {
+		value /= exact_powers_of_ten[-exponent];
+	} else {
+		value *= exact_powers_of_ten[exponent];
+	}
+	return (float) (negative ? -value : value);
+}
+
+static inline bool parseInt(const char*& p, const char* end, int& value) {
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		p++;
+	}
+	if (p >= end || !isDigit(*p)) {
+		return false;
+	}
+	int v = 0;
+	while (p < end && isDigit(*p)) {
+		v = v * 10 + (*p - '0');
+		p++;
+	}
+	value = negative ? -v : v;
+	return true;
+}
+
+// Negative face indices count back from the end of the attributes parsed so far. Inside a chunk
+// they are resolved against the chunk's own attributes and stored with this bias until the
+// attribute counts of the previous chunks are known.
+#define OBJ_RELATIVE_INDEX_BIAS (INT_MIN / 2)
+// Material of faces that precede the first usemtl statement of a chunk
+#define OBJ_INHERITED_MATERIAL -2
+
+// Converts a one based or negative relative index into a zero based index
+static inline int chunkIndex(int index, size_t count) {
+	if (index > 0) {
+		return index - 1;
+	}
+	if (index < 0) {
+		return OBJ_RELATIVE_INDEX_BIAS + (int) count + index;
+	}
+	return -1;
+}
+
+// Resolves a chunk relative index once the number of attributes in the previous chunks is known
+static inline int resolveIndex(int index, int base) {
+	if (index >= -1) {
+		return index;
+	}
+	index = index - OBJ_RELATIVE_INDEX_BIAS + base;
+	return index >= 0 ? index : -1;
+}
+
+typedef struct ObjChunk {
+	Attrib attrib;
+	// shapes[0] holds the faces before the first o or g statement, which continue the shape of the previous chunk
+	std::vector<Shape> shapes;
+	// Material ids of the faces refer to these names
+	std::vector<std::string> material_names;
+	std::vector<std::string> mtllibs;
+	// The material in use at the end of the chunk
+	int final_material;
+} ObjChunk;
+
+static inline void parseFloats(const char* p, const char* end, std::vector<float>& out, int count) {
+	for (int i = 0; i < count; i++) {
+		skipSpace(p, end);
+		out.push_back(p < end ? parseFloat(p, end) : 0.f);
+	}
+}
+
+static void parseFace(const char* p, const char* end, ObjChunk& chunk, Shape& shape,
+		int material_id, std::vector<Index>& face) {
+	size_t num_vertices = chunk.attrib.vertices.size() / 3;
+	size_t num_normals = chunk.attrib.normals.size() / 3;
+	size_t num_texcoords = chunk.attrib.texcoords.size() / 2;
+	face.clear();
+	while (true) {
+		skipSpace(p, end);
+		if (p >= end) {
+			break;
+		}
+		Index index;
+		index.vertex_index = -1;
+		index.normal_index = -1;
+		index.texcoord_index = -1;
+		int v;
+		if (!parseInt(p, end, v)) {
+			skipToken(p, end);
+			continue;
+		}
+		index.vertex_index = chunkIndex(v, num_vertices);
+		if (p < end && *p == '/') {
+			p++;
+			if (parseInt(p, end, v)) {
+				index.texcoord_index = chunkIndex(v, num_texcoords);
+			}
+			if (p < end && *p == '/') {
+				p++;
+				if (parseInt(p, end, v)) {
+					index.normal_index = chunkIndex(v, num_normals);
+				}
+			}
+		}
+		skipToken(p, end);
+		face.push_back(index);
+	}
+	// Triangulate polygons as a fan around the first vertex
+	for (size_t i = 2; i < face.size(); i++) {
+		shape.mesh.indices.push_back(face[0]);
+		shape.mesh.indices.push_back(face[i - 1]);
+		shape.mesh.indices.push_back(face[i]);
+		shape.mesh.material_ids.push_back(material_id);
+	}
+}
+
+// Appends the file names listed after mtllib, comments end the list
+static void parseMtllibList(const char* p, const char* end, std::vector<std::string>& mtllibs) {
+	const char* comment = (const char*) memchr(p, '#', end - p);
+	const char* list_end = comment ? comment : end;
+	while (true) {
+		skipSpace(p, list_end);
+		if (p >= list_end) {
+			break;
+		}
+		const char* name_start = p;
+		skipToken(p, list_end);
+		mtllibs.push_back(std::string(name_start, p));
+	}
+}
+
+// Parses whole lines in [p, end) without knowing the state left by the preceding lines
+static void parseChunk(const char* p, const char* end, ObjChunk& chunk) {
+	std::map<std::string, int> material_name_ids;
+	std::vector<Index> face;
+	chunk.shapes.push_back(Shape());
+	int material_id = OBJ_INHERITED_MATERIAL;
+	while (p < end) {
+		const char* line_end = findLineEnd(p, end);
+		const char* le = line_end;
+		while (le > p && (le[-1] == '\r' || isSpace(le[-1]))) {
+			le--;
+		}
+		const char* lp = p;
+		p = line_end < end ? line_end + 1 : end;
+		skipSpace(lp, le);
+		if (lp >= le) {
+			continue;
+		}
+		switch (*lp) {
+		case 'v':
+			if (keyword(lp, le, "v", 1)) {
+				parseFloats(lp, le, chunk.attrib.vertices, 3);
+			} else if (keyword(lp, le, "vn", 2)) {
+				parseFloats(lp, le, chunk.attrib.normals, 3);
+			} else if (keyword(lp, le, "vt", 2)) {
+				parseFloats(lp, le, chunk.attrib.texcoords, 2);
+			}
+			break;
+		case 'f':
+			if (keyword(lp, le, "f", 1)) {
+				parseFace(lp, le, chunk, chunk.shapes.back(), material_id, face);
+			}
+			break;
+		case 'o':
+		case 'g':
+			if (keyword(lp, le, "o", 1) || keyword(lp, le, "g", 1)) {
+				// A shape without faces is renamed, the continuation of the previous chunk never is
+				if (chunk.shapes.size() == 1 || chunk.shapes.back().mesh.indices.size() > 0) {
+					chunk.shapes.push_back(Shape());
+				}
+				chunk.shapes.back().name = restOfLine(lp, le);
+			}
+			break;
+		case 'u':
+			if (keyword(lp, le, "usemtl", 6)) {
+				std::string material_name = restOfLine(lp, le);
+				std::map<std::string, int>::iterator it = material_name_ids.find(material_name);
+				if (it == material_name_ids.end()) {
+					material_id = (int) chunk.material_names.size();
+					material_name_ids[material_name] = material_id;
+					chunk.material_names.push_back(material_name);
+				} else {
+					material_id = it->second;
+				}
+			}
+			break;
+		case 'm':
+			if (keyword(lp, le, "mtllib", 6)) {
+				parseMtllibList(lp, le, chunk.mtllibs);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	chunk.final_material = material_id;
+}
+
+template<typename T>
+static inline void appendVector(std::vector<T>& to, std::vector<T>& from) {
+	if (to.empty()) {
+		to.swap(from);
+	} else {
+		to.insert(to.end(), from.begin(), from.end());
+	}
+}
+
+static inline bool validIndex(int index, size_t count) {
+	return index >= 0 && (size_t) index < count;
+}
+
+// Removes the triangles that refer to attributes outside of attrib, a missing texture
+// coordinate or normal is allowed. Returns the number of triangles removed.
+static size_t removeInvalidFaces(Mesh& mesh, const Attrib& attrib) {
+	size_t num_vertices = attrib.vertices.size() / 3;
+	size_t num_normals = attrib.normals.size() / 3;
+	size_t num_texcoords = attrib.texcoords.size() / 2;
+	size_t num_faces = mesh.indices.size() / 3;
+	size_t kept = 0;
+	for (size_t f = 0; f < num_faces; f++) {
+		bool valid = true;
+		for (int c = 0; c < 3; c++) {
+			const Index& index = mesh.indices[3 * f + c];
+			valid = valid && validIndex(index.vertex_index, num_vertices)
+					&& (index.texcoord_index == -1 || validIndex(index.texcoord_index, num_texcoords))
+					&& (index.normal_index == -1 || validIndex(index.normal_index, num_normals));
+		}
+		if (!valid) {
+			continue;
+		}
+		if (kept != f) {
+			std::copy(mesh.indices.begin() + 3 * f, mesh.indices.begin() + 3 * f + 3, mesh.indices.begin() + 3 * kept);
+			mesh.material_ids[kept] = mesh.material_ids[f];
+		}
+		kept++;
+	}
+	mesh.indices.resize(3 * kept);
+	mesh.material_ids.resize(kept);
+	return num_faces - kept;
+}
+
+// Appends a chunk to the result, current_shape and current_material carry the state between chunks.
+// Faces are checked against the attributes parsed up to the end of the chunk, faces only refer
+// to attributes defined before them.
+static void mergeChunk(ObjChunk& chunk, ObjData& obj, Shape& current_shape, int& current_material,
+		std::map<std::string, int>& material_name_ids) {
+	int vertex_base = (int) (obj.attrib.vertices.size() / 3);
+	int normal_base = (int) (obj.attrib.normals.size() / 3);
+	int texcoord_base = (int) (obj.attrib.texcoords.size() / 2);
+	appendVector(obj.attrib.vertices, chunk.attrib.vertices);
+	appendVector(obj.attrib.normals, chunk.attrib.normals);
+	appendVector(obj.attrib.texcoords, chunk.attrib.texcoords);
+	obj.mtllibs.insert(obj.mtllibs.end(), chunk.mtllibs.begin(), chunk.mtllibs.end());
+
+	std::vector<int> material_remap;
+	for (size_t i = 0; i < chunk.material_names.size(); i++) {
+		const std::string& material_name = chunk.material_names[i];
+		std::map<std::string, int>::iterator it = material_name_ids.find(material_name);
+		if (it == material_name_ids.end()) {
+			int material_id = (int) obj.material_names.size();
+			material_name_ids[material_name] = material_id;
+			obj.material_names.push_back(material_name);
+			material_remap.push_back(material_id);
+		} else {
+			material_remap.push_back(it->second);
+		}
+	}
+
+	for (size_t s = 0; s < chunk.shapes.size(); s++) {
+		Mesh& mesh = chunk.shapes[s].mesh;
+		for (std::vector<Index>::iterator it = mesh.indices.begin(); it != mesh.indices.end(); ++it) {
+			it->vertex_index = resolveIndex(it->vertex_index, vertex_base);
+			it->normal_index = resolveIndex(it->normal_index, normal_base);
+			it->texcoord_index = resolveIndex(it->texcoord_index, texcoord_base);
+		}
+		obj.invalid_faces += removeInvalidFaces(mesh, obj.attrib);
+		for (std::vector<int>::iterator it = mesh.material_ids.begin(); it != mesh.material_ids.end(); ++it) {
+			if (*it == OBJ_INHERITED_MATERIAL) {
+				*it = current_material;
+			} else if (*it >= 0) {
+				*it = material_remap[*it];
+			}
+		}
+		if (s > 0) {
+			if (current_shape.mesh.indices.size() > 0) {
+				obj.shapes.push_back(Shape());
+				std::swap(obj.shapes.back(), current_shape);
+			}
+			current_shape = Shape();
+			current_shape.name.swap(chunk.shapes[s].name);
+		}
+		appendVector(current_shape.mesh.indices, mesh.indices);
+		appendVector(current_shape.mesh.material_ids, mesh.material_ids);
+	}
+	if (chunk.final_material != OBJ_INHERITED_MATERIAL) {
+		current_material = material_remap[chunk.final_material];
+	}
+}
+
+// Parses the chunks between bounds, all but the first on the pool
+static void parseChunks(const std::vector<const char*>& bounds, std::vector<ObjChunk>& chunks, ThreadPool* pool) {
+	std::vector<std::future<void> > parsed;
+	for (size_t i = 1; i < chunks.size(); i++) {
+		const char* chunk_begin = bounds[i];
+		const char* chunk_end = bounds[i + 1];
+		ObjChunk* chunk = &chunks[i];
+		parsed.push_back(pool->submit([chunk_begin, chunk_end, chunk]() {
+			parseChunk(chunk_begin, chunk_end, *chunk);
+		}));
+	}
+	parseChunk(bounds[0], bounds[1], chunks[0]);
+	// The tasks write into chunks, so all of them finish before any error is rethrown
+	for (size_t i = 0; i < parsed.size(); i++) {
+		parsed[i].wait();
+	}
+	for (size_t i = 0; i < parsed.size(); i++) {
+		parsed[i].get();
+	}
+}
+
+bool parseObj(const char* data, size_t length, ObjData& obj, ThreadPool* pool) {
+	const char* end = data + length;
+	obj.invalid_faces = 0;
+	size_t num_chunks = 1;
+	if (pool && pool->size() > 1 && length >= 2 * OBJ_PARSE_CHUNK_SIZE) {
+		num_chunks = std::min(pool->size(), length / OBJ_PARSE_CHUNK_SIZE);
+	}
+	// Chunks start at the beginning of a line
+	std::vector<const char*> bounds;
+	bounds.push_back(data);
+	for (size_t i = 1; i < num_chunks; i++) {
+		const char* bound = data + length / num_chunks * i;
+		if (bound < bounds.back()) {
+			bound = bounds.back();
+		}
+		bound = findLineEnd(bound, end);
+		bounds.push_back(bound < end ? bound + 1 : end);
+	}
+	bounds.push_back(end);
+
+	std::vector<ObjChunk> chunks(num_chunks);
+	parseChunks(bounds, chunks, pool);
+
+	Shape current_shape;
+	int current_material = -1;
+	std::map<std::string, int> material_name_ids;
+	for (size_t i = 0; i < num_chunks; i++) {
+		mergeChunk(chunks[i], obj, current_shape, current_material, material_name_ids);
+		// Release the chunk as soon as it is merged to bound the peak memory
+		chunks[i] = ObjChunk();
+	}
+	if (current_shape.mesh.indices.size() > 0) {
+		obj.shapes.push_back(Shape());
+		std::swap(obj.shapes.back(), current_shape);
+	}
+	return true;
+}
+
+void scanMtllibs(const char* data, size_t length, std::vector<std::string>& mtllibs) {
+	const char* p = data;
+	const char* end = data + length;
+	while (p < end) {
+		const char* line_end = findLineEnd(p, end);
+		const char* lp = p;
+		p = line_end < end ? line_end + 1 : end;
+		skipSpace(lp, line_end);
+		if (lp < line_end && *lp == 'm' && keyword(lp, line_end, "mtllib", 6)) {
+			const char* le = line_end;
+			while (le > lp && (le[-1] == '\r' || isSpace(le[-1]))) {
+				le--;
+			}
+			parseMtllibList(lp, le, mtllibs);
+		}
+	}
+}
+
+// Hands the complete shapes to the callback, then frees them
+static void emitShapes(ObjData& obj, const ShapeCallback& emit_shape) {
+	for (size_t s = 0; s < obj.shapes.size(); s++) {
+		emit_shape(obj, obj.shapes[s]);
+	}
+	std::vector<Shape>().swap(obj.shapes);
+}
+
+bool parseObjStreaming(const char* data, size_t length, ObjData& obj, const ShapeCallback& emit_shape,
+		ThreadPool* pool) {
+	const char* end = data + length;
+	obj.invalid_faces = 0;
+	size_t chunks_per_round = pool && pool->size() > 1 ? pool->size() : 1;
+	Shape current_shape;
+	int current_material = -1;
+	std::map<std::string, int> material_name_ids;
+	const char* p = data;
+	while (p < end) {
+		// A round parses at most chunks_per_round chunks that start at the beginning of a line
+		std::vector<const char*> bounds;
+		bounds.push_back(p);
+		while (bounds.size() <= chunks_per_round && bounds.back() < end) {
+			size_t remaining = (size_t) (end - bounds.back());
+			const char* bound = findLineEnd(bounds.back() + std::min(remaining, (size_t) OBJ_PARSE_CHUNK_SIZE), end);
+			bounds.push_back(bound < end ? bound + 1 : end);
+		}
+		std::vector<ObjChunk> chunks(bounds.size() - 1);
+		parseChunks(bounds, chunks, pool);
+		for (size_t i = 0; i < chunks.size(); i++) {
+			mergeChunk(chunks[i], obj, current_shape, current_material, material_name_ids);
+			chunks[i] = ObjChunk();
+			emitShapes(obj, emit_shape);
+		}
+		p = bounds.back();
+	}
+	if (current_shape.mesh.indices.size() > 0) {
+		obj.shapes.push_back(Shape());
+		std::swap(obj.shapes.back(), current_shape);
+	}
+	emitShapes(obj, emit_shape);
+	return true;
+}
+
+void parseMtl(const char* data, size_t length, std::vector<Material>& materials,
+		std::map<std::string, int>& material_map) {
+	const char* p = data;
+	const char* end = data + length;
+	Material* material = 0;
+	while (p < end) {
+		const char* line_end = findLineEnd(p, end);
+		const char* le = line_end;
+		while (le > p && (le[-1] == '\r' || isSpace(le[-1]))) {
+			le--;
+		}
+		const char* lp = p;
+		p = line_end < end ? line_end + 1 : end;
+		skipSpace(lp, le);
+		if (lp >= le) {
+			continue;
+		}
+		if (keyword(lp, le, "newmtl", 6)) {
+			Material m;
+			m.name = restOfLine(lp, le);
+			m.diffuse[0] = m.diffuse[1] = m.diffuse[2] = 0.f;
+			material_map[m.name] = (int) materials.size();
+			materials.push_back(m);
+			material = &materials.back();
+		} else if (!material) {
+			continue;
+		} else if (keyword(lp, le, "Kd", 2)) {
+			for (int i = 0; i < 3; i++) {
+				skipSpace(lp, le);
+				material->diffuse[i] = lp < le ? parseFloat(lp, le) : 0.f;
+			}
+		} else if (keyword(lp, le, "map_Kd", 6)) {
+			// Texture options such as -bm 1.0 precede the file name
+			if (*lp == '-') {
+				const char* name_start = le;
+				while (name_start > lp && !isSpace(name_start[-1])) {
+					name_start--;
+				}
+				lp = name_start;
+			}
+			material->diffuse_texname = restOfLine(lp, le);
+		}
+	}
+}
+
+void resolveMaterials(ObjData& obj, const std::map<std::string, int>& material_map) {
+	for (std::vector<Shape>::iterator it = obj.shapes.begin(); it != obj.shapes.end(); ++it) {
+		resolveMaterials(*it, obj.material_names, material_map);
+	}
+	obj.material_names.clear();
+}
+
+void resolveMaterials(Shape& shape, const std::vector<std::string>& material_names,
+		const std::map<std::string, int>& material_map) {
+	std::vector<int> remap;
+	for (size_t i = 0; i < material_names.size(); i++) {
+		std::map<std::string, int>::const_iterator it = material_map.find(material_names[i]);
+		remap.push_back(it == material_map.end() ? -1 : it->second);
+	}
+	std::vector<int>& material_ids = shape.mesh.material_ids;
+	for (size_t f = 0; f < material_ids.size(); f++) {
+		if (material_ids[f] >= 0) {
+			material_ids[f] = remap[material_ids[f]];
+		}
+	}
+}
+
+} // namespace wavefront
@@ -0,0 +1,24 @@
+// Copyright (C) 2017 Chris Liebert
+
+#include "graphics/scene_arena.h"
+
+namespace scenegraph {
+
+SceneArena::~SceneArena() {
+	release();
+}
+
+void SceneArena::release() {
+	std::lock_guard<std::mutex> lock(mutex);
+	groups.release();
+	geometry.release();
+	materials.release();
+	switches.release();
+	transforms.release();
+}
+
+size_t SceneArena::size() const {
+	return groups.size() + geometry.size() + materials.size() + switches.size() + transforms.size();
+}
+
+} // namespace scenegraph
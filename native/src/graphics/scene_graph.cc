@@ -1,7 +1,15 @@
 // Copyright (C) 2017 Chris Liebert
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <new>
+
 #include "graphics/gl_code.h"
 #include "graphics/scene_graph.h"
+#include "graphics/transform_store.h"
+#include "graphics/vertex_packing.h"
 
 namespace scenegraph {
 
@@ -22,7 +30,166 @@ bool Vertex::operator==(const Vertex& other) const {
 
 GeometryNode::GeometryNode() {
 	type = Geometry;
+	for (int i = 0; i < 3; i++) {
+		center[i] = aabb_min[i] = aabb_max[i] = sphere_center[i] = 0.f;
+	}
 	radius = 0.f;
+	vertex_format = FloatVertexFormat;
+	position_scale = 1.f;
+	index_type = GL_UNSIGNED_INT;
+}
+
+void GeometryNode::compactIndices() {
+	if (index_type != GL_UNSIGNED_INT || vertexCount() > 65536) {
+		return;
+	}
+	index_data_16.assign(index_data.begin(), index_data.end());
+	std::vector<GLuint>().swap(index_data);
+	index_type = GL_UNSIGNED_SHORT;
+}
+
+size_t GeometryNode::indexCount() const {
+	return index_type == GL_UNSIGNED_SHORT ? index_data_16.size() : index_data.size();
+}
+
+GLuint GeometryNode::index(size_t i) const {
+	return index_type == GL_UNSIGNED_SHORT ? (GLuint) index_data_16[i] : index_data[i];
+}
+
+const GLvoid* GeometryNode::indexData() const {
+	if (index_type == GL_UNSIGNED_SHORT) {
+		return index_data_16.data();
+	}
+	return index_data.data();
+}
+
+size_t GeometryNode::indexDataSize() const {
+	if (index_type == GL_UNSIGNED_SHORT) {
+		return sizeof(GLushort) * index_data_16.size();
+	}
+	return sizeof(GLuint) * index_data.size();
+}
+
+size_t GeometryNode::indexSize() const {
+	return index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+size_t GeometryNode::lodCount() const {
+	return lods.empty() ? 1 : lods.size();
+}
+
+LodLevel GeometryNode::lod(size_t level) const {
+	if (lods.empty()) {
+		LodLevel full_detail;
+		full_detail.first_index = 0;
+		full_detail.index_count = (GLuint) indexCount();
+		full_detail.error = 0.f;
+		return full_detail;
+	}
+	return lods[level];
+}
+
+size_t GeometryNode::selectLod(const glm::mat4& model_matrix, const Camera& camera, float max_pixel_error) const {
+	if (lods.size() < 2 || camera.viewport_height <= 0) {
+		return 0;
+	}
+	glm::vec4 view_center = camera.modelview_matrix * model_matrix
+			* glm::vec4(sphere_center[0], sphere_center[1], sphere_center[2], 1.f);
+	float scale = 0.f;
+	for (int i = 0; i < 3; i++) {
+		float column_length = sqrtf(model_matrix[i][0] * model_matrix[i][0]
+				+ model_matrix[i][1] * model_matrix[i][1] + model_matrix[i][2] * model_matrix[i][2]);
+		scale = std::max(scale, column_length);
+	}
+	float center_distance = sqrtf(view_center.x * view_center.x + view_center.y * view_center.y
+			+ view_center.z * view_center.z);
+	// Distance to the nearest point of the bounding sphere
+	float distance = center_distance - radius * scale;
+	if (distance <= 0.f) {
+		return 0;
+	}
+	float pixels_per_unit = camera.projection_matrix[1][1] * 0.5f * (float) camera.viewport_height / distance;
+	for (size_t level = lods.size() - 1; level > 0; level--) {
+		if (lods[level].error * scale * pixels_per_unit <= max_pixel_error) {
+			return level;
+		}
+	}
+	return 0;
+}
+
+void GeometryNode::packVertices() {
+	if (vertex_format == PackedVertexFormat) {
+		return;
+	}
+	float max_component = 0.f;
+	for (size_t i = 0; i < vertex_data.size(); i++) {
+		for (int j = 0; j < 3; j++) {
+			float component = fabsf(vertex_data[i].position[j]);
+			if (component > max_component) {
+				max_component = component;
+			}
+		}
+	}
+	position_scale = max_component > 0.f ? max_component : 1.f;
+	packed_vertex_data.resize(vertex_data.size());
+	for (size_t i = 0; i < vertex_data.size(); i++) {
+		const Vertex& vertex = vertex_data[i];
+		PackedVertex& packed = packed_vertex_data[i];
+		for (int j = 0; j < 3; j++) {
+			packed.position[j] = floatToSnorm16(vertex.position[j] / position_scale);
+		}
+		packed.position[3] = 0;
+		octEncode(vertex.normal, packed.normal);
+		packed.texcoord[0] = floatToHalf(vertex.texcoord[0]);
+		packed.texcoord[1] = floatToHalf(vertex.texcoord[1]);
+	}
+	std::vector<Vertex>().swap(vertex_data);
+	vertex_format = PackedVertexFormat;
+}
+
+size_t GeometryNode::vertexCount() const {
+	return vertex_format == PackedVertexFormat ? packed_vertex_data.size() : vertex_data.size();
+}
+
+void GeometryNode::getPosition(size_t i, float position[3]) const {
+	for (int j = 0; j < 3; j++) {
+		if (vertex_format == PackedVertexFormat) {
+			position[j] = snorm16ToFloat(packed_vertex_data[i].position[j]) * position_scale;
+		} else {
+			position[j] = vertex_data[i].position[j];
+		}
+	}
+}
+
+const GLvoid* GeometryNode::vertexData() const {
+	if (vertex_format == PackedVertexFormat) {
+		return packed_vertex_data.data();
+	}
+	return vertex_data.data();
+}
+
+size_t GeometryNode::vertexDataSize() const {
+	return vertexCount() * vertexStride();
+}
+
+GLsizei GeometryNode::vertexStride() const {
+	return vertex_format == PackedVertexFormat ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+void GeometryNode::unpackVertices(std::vector<Vertex>& vertices) const {
+	if (vertex_format != PackedVertexFormat) {
+		vertices = vertex_data;
+		return;
+	}
+	vertices.resize(packed_vertex_data.size());
+	for (size_t i = 0; i < packed_vertex_data.size(); i++) {
+		const PackedVertex& packed = packed_vertex_data[i];
+		Vertex& vertex = vertices[i];
+		getPosition(i, vertex.position);
+		octDecode(packed.normal, vertex.normal);
+		vertex.texcoord[0] = halfToFloat(packed.texcoord[0]);
+		vertex.texcoord[1] = halfToFloat(packed.texcoord[1]);
+	}
 }
 
 MaterialNode::MaterialNode() {
@@ -31,48 +198,73 @@ MaterialNode::MaterialNode() {
 
 Node::Node() {
 	type = Group;
+	name = EMPTY_NAME_ID;
 	num_children = 0;
+	references = 1;
+	pooled = false;
 }
 
-Node* find(std::string& search, Node* node) {
-	if (search.compare(node->name) == 0) {
+void Node::setName(const std::string& new_name) {
+	name = StringInterner::global().intern(new_name);
+}
+
+const std::string& Node::getName() const {
+	return StringInterner::global().str(name);
+}
+
+Node* find(NameId search, Node* node) {
+	if (node->name == search) {
 		return node;
-	} else {
-		Node* n2 = 0;
-		for (std::vector<Node*>::iterator it = node->children.begin();
-				it != node->children.end(); ++it) {
-			Node* c = *it;
-			n2 = scenegraph::find(search, c);
-			if (n2 != 0)
-				return n2;
-		}
-		return n2;
 	}
+	for (std::vector<Node*>::iterator it = node->children.begin();
+			it != node->children.end(); ++it) {
+		Node* n2 = scenegraph::find(search, *it);
+		if (n2 != 0)
+			return n2;
+	}
+	return 0;
 }
 
-Node* find(std::string& search, Node* node, NodeType type) {
-	if (type == node->type && search.compare(node->name) == 0) {
+Node* find(NameId search, Node* node, NodeType type) {
+	if (type == node->type && node->name == search) {
 		return node;
-	} else {
-		Node* n2 = 0;
-		for (std::vector<Node*>::iterator it = node->children.begin();
-				it != node->children.end(); ++it) {
-			n2 = scenegraph::find(search, *it, type);
-			if (n2 != 0)
-				return n2;
-		}
-		return n2;
 	}
+	for (std::vector<Node*>::iterator it = node->children.begin();
+			it != node->children.end(); ++it) {
+		Node* n2 = scenegraph::find(search, *it, type);
+		if (n2 != 0)
+			return n2;
+	}
+	return 0;
+}
+
+// A name that was never interned does not belong to any node
+Node* find(std::string& search, Node* node) {
+	NameId id;
+	if (!StringInterner::global().lookup(search, id)) {
+		return 0;
+	}
+	return scenegraph::find(id, node);
 }
 
+Node* find(std::string& search, Node* node, NodeType type) {
+	NameId id;
+	if (!StringInterner::global().lookup(search, id)) {
+		return 0;
+	}
+	return scenegraph::find(id, node, type);
+}
 
 Node* Node::find(std::string& search) {
 	return scenegraph::find(search, this);
 }
 
 Node* Node::find(const char* search) {
-	std::string s(search);
-	return scenegraph::find(s, this);
+	NameId id;
+	if (!StringInterner::global().lookup(search, strlen(search), id)) {
+		return 0;
+	}
+	return scenegraph::find(id, this);
 }
 
 Node* Node::find(std::string& search, NodeType search_type) {
@@ -80,8 +272,11 @@ Node* Node::find(std::string& search, NodeType search_type) {
 }
 
 Node* Node::find(const char* search, NodeType search_type) {
-	std::string s(search, search_type);
-	return scenegraph::find(s, this, search_type);
+	NameId id;
+	if (!StringInterner::global().lookup(search, strlen(search), id)) {
+		return 0;
+	}
+	return scenegraph::find(id, this, search_type);
 }
 
 TransformNode* find_transform_node(std::string& search, Node* root) {
@@ -89,13 +284,192 @@ TransformNode* find_transform_node(std::string& search, Node* root) {
 }
 
 TransformNode* find_transform_node(const char* search, Node* root) {
-	std::string s(search);
-	return scenegraph::find_transform_node(s, root);
+	NameId id;
+	if (!StringInterner::global().lookup(search, strlen(search), id)) {
+		return 0;
+	}
+	return (TransformNode*) scenegraph::find(id, root, Transform);
+}
+
+template<typename node_t>
+static void emptyPooled(node_t* node) {
+	node->~node_t();
+	new (node) node_t();
+	node->pooled = true;
+}
+
+void releasePooled(Node* node) {
+	switch (node->type) {
+	case Geometry:
+		emptyPooled((GeometryNode*) node);
+		break;
+	case Material:
+		emptyPooled((MaterialNode*) node);
+		break;
+	case Switch:
+		emptyPooled((SwitchNode*) node);
+		break;
+	case Transform:
+		emptyPooled((TransformNode*) node);
+		break;
+	default:
+		emptyPooled(node);
+		break;
+	}
+}
+
+NodeIndex::NodeIndex() {
+	num_nodes = 0;
+	root = 0;
+}
+
+void NodeIndex::build(Node* _root) {
+	clear();
+	root = _root;
+	if (root) {
+		add(root);
+	}
+}
+
+void NodeIndex::clear() {
+	nodes.clear();
+	num_nodes = 0;
+	root = 0;
+}
+
+void NodeIndex::add(Node* node) {
+	nodes[node->name].push_back(node);
+	num_nodes++;
+	for (std::vector<Node*>::iterator it = node->children.begin(); it != node->children.end(); ++it) {
+		add(*it);
+	}
+}
+
+void NodeIndex::add(Node* node, const std::set<NameId>& names) {
+	if (names.count(node->name)) {
+		nodes[node->name].push_back(node);
+		num_nodes++;
+	}
+	for (std::vector<Node*>::iterator it = node->children.begin(); it != node->children.end(); ++it) {
+		add(*it, names);
+	}
+}
+
+void NodeIndex::collectNames(Node* node, std::set<NameId>& names) {
+	names.insert(node->name);
+	for (std::vector<Node*>::iterator it = node->children.begin(); it != node->children.end(); ++it) {
+		collectNames(*it, names);
+	}
+}
+
+void NodeIndex::remove(Node* node) {
+	std::unordered_map<NameId, std::vector<Node*> >::iterator entry = nodes.find(node->name);
+	if (entry != nodes.end()) {
+		std::vector<Node*>& named = entry->second;
+		std::vector<Node*>::iterator it = std::find(named.begin(), named.end(), node);
+		if (it != named.end()) {
+			named.erase(it);
+			num_nodes--;
+		}
+		if (named.empty()) {
+			nodes.erase(entry);
+		}
+	}
+	for (std::vector<Node*>::iterator it = node->children.begin(); it != node->children.end(); ++it) {
+		remove(*it);
+	}
+}
+
+void NodeIndex::addChild(Node* parent, Node* child, TransformStore& transforms) {
+	assert(parent && child);
+	parent->children.push_back(child);
+	if (!root) {
+		add(child);
+		transforms.invalidate();
+		return;
+	}
+	// The new nodes may come before nodes already indexed with the same name
+	std::set<NameId> names;
+	collectNames(child, names);
+	for (std::set<NameId>::iterator it = names.begin(); it != names.end(); ++it) {
+		std::unordered_map<NameId, std::vector<Node*> >::iterator entry = nodes.find(*it);
+		if (entry != nodes.end()) {
+			num_nodes -= entry->second.size();
+			nodes.erase(entry);
+		}
+	}
+	add(root, names);
+	transforms.build(root);
+}
+
+bool NodeIndex::removeChild(Node* parent, Node* child, TransformStore& transforms) {
+	std::vector<Node*>::iterator it = std::find(parent->children.begin(), parent->children.end(), child);
+	if (it == parent->children.end()) {
+		return false;
+	}
+	parent->children.erase(it);
+	remove(child);
+	if (root) {
+		transforms.build(root);
+	} else {
+		transforms.invalidate();
+	}
+	return true;
+}
+
+Node* NodeIndex::find(NameId name) const {
+	std::unordered_map<NameId, std::vector<Node*> >::const_iterator entry = nodes.find(name);
+	if (entry == nodes.end() || entry->second.empty()) {
+		return 0;
+	}
+	return entry->second.front();
+}
+
+Node* NodeIndex::find(NameId name, NodeType type) const {
+	std::unordered_map<NameId, std::vector<Node*> >::const_iterator entry = nodes.find(name);
+	if (entry == nodes.end()) {
+		return 0;
+	}
+	for (std::vector<Node*>::const_iterator it = entry->second.begin(); it != entry->second.end(); ++it) {
+		if ((*it)->type == type) {
+			return *it;
+		}
+	}
+	return 0;
+}
+
+Node* NodeIndex::find(const std::string& name) const {
+	NameId id;
+	if (!StringInterner::global().lookup(name, id)) {
+		return 0;
+	}
+	return find(id);
+}
+
+Node* NodeIndex::find(const std::string& name, NodeType type) const {
+	NameId id;
+	if (!StringInterner::global().lookup(name, id)) {
+		return 0;
+	}
+	return find(id, type);
+}
+
+TransformNode* NodeIndex::findTransform(NameId name) const {
+	return (TransformNode*) find(name, Transform);
+}
+
+TransformNode* NodeIndex::findTransform(const std::string& name) const {
+	return (TransformNode*) find(name, Transform);
+}
+
+size_t NodeIndex::size() const {
+	return num_nodes;
 }
 
 TransformNode::TransformNode() {
 	type = Transform;
 	matrix = glm::mat4(1.f);
+	transform = TRANSFORM_NONE;
 }
 
 } // namespace scenegraph
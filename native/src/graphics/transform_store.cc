@@ -0,0 +1,256 @@
+// Copyright (C) 2017 Chris Liebert
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <functional>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "graphics/transform_store.h"
+
+using namespace scenegraph;
+
+// out = a * b for column major matrices. Each column of out is a sum of the columns of a
+// scaled by one column of b, which compilers turn into four wide multiply adds.
+static inline void multiply(const float* a, const float* b, float* out) {
+	for (int column = 0; column < 4; column++) {
+		float sum[4];
+		for (int row = 0; row < 4; row++) {
+			sum[row] = a[row] * b[column * 4];
+		}
+		for (int k = 1; k < 4; k++) {
+			float scale = b[column * 4 + k];
+			for (int row = 0; row < 4; row++) {
+				sum[row] += a[k * 4 + row] * scale;
+			}
+		}
+		for (int row = 0; row < 4; row++) {
+			out[column * 4 + row] = sum[row];
+		}
+	}
+}
+
+static const BoundingSphere empty_sphere = { { 0.f, 0.f, 0.f }, -1.f };
+
+// Smallest sphere around a and b
+static BoundingSphere merge(const BoundingSphere& a, const BoundingSphere& b) {
+	if (b.radius < 0.f) {
+		return a;
+	}
+	if (a.radius < 0.f) {
+		return b;
+	}
+	float offset[3] = { b.center[0] - a.center[0], b.center[1] - a.center[1], b.center[2] - a.center[2] };
+	float distance = sqrtf(offset[0] * offset[0] + offset[1] * offset[1] + offset[2] * offset[2]);
+	if (distance + b.radius <= a.radius) {
+		return a;
+	}
+	if (distance + a.radius <= b.radius) {
+		return b;
+	}
+	BoundingSphere merged;
+	merged.radius = 0.5f * (distance + a.radius + b.radius);
+	float t = (merged.radius - a.radius) / distance;
+	for (int i = 0; i < 3; i++) {
+		merged.center[i] = a.center[i] + offset[i] * t;
+	}
+	return merged;
+}
+
+// The sphere moved by matrix, its radius grows with the largest scale of the matrix
+static BoundingSphere transformSphere(const float* matrix, const BoundingSphere& sphere) {
+	if (sphere.radius < 0.f) {
+		return sphere;
+	}
+	BoundingSphere moved;
+	for (int row = 0; row < 3; row++) {
+		moved.center[row] = matrix[row] * sphere.center[0] + matrix[4 + row] * sphere.center[1]
+				+ matrix[8 + row] * sphere.center[2] + matrix[12 + row];
+	}
+	float max_scale = 0.f;
+	for (int column = 0; column < 3; column++) {
+		const float* axis = matrix + column * 4;
+		max_scale = std::max(max_scale, axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	}
+	moved.radius = sphere.radius * sqrtf(max_scale);
+	return moved;
+}
+
+TransformStore::TransformStore() {
+	layout_current = false;
+}
+
+void TransformStore::build(Node* root) {
+	std::vector<glm::mat4> previous_local;
+	std::vector<const TransformNode*> previous_owners;
+	previous_local.swap(local);
+	previous_owners.swap(owners);
+	local_bounds.clear();
+	handles.clear();
+	parents.clear();
+	ends.clear();
+	dirty.clear();
+	if (root) {
+		add(root, -1, previous_local, previous_owners);
+	}
+	// Group the occurrences by node so a changed node finds its occurrences
+	occurrence_offsets.assign(local.size() + 1, 0);
+	for (size_t i = 0; i < handles.size(); i++) {
+		occurrence_offsets[handles[i] + 1]++;
+	}
+	for (size_t h = 0; h < local.size(); h++) {
+		occurrence_offsets[h + 1] += occurrence_offsets[h];
+	}
+	occurrence_list.resize(handles.size());
+	std::vector<uint32_t> next(occurrence_offsets.begin(), occurrence_offsets.end() - 1);
+	for (size_t i = 0; i < handles.size(); i++) {
+		occurrence_list[next[handles[i]]++] = (uint32_t) i;
+	}
+	worlds.resize(handles.size());
+	world_bounds.resize(handles.size());
+	updateRange(0, handles.size());
+	layout_current = true;
+}
+
+void TransformStore::invalidate() {
+	layout_current = false;
+}
+
+bool TransformStore::current() const {
+	return layout_current;
+}
+
+void TransformStore::add(Node* node, int32_t parent, const std::vector<glm::mat4>& previous_local,
+		const std::vector<const TransformNode*>& previous_owners) {
+	int32_t occurrence = -1;
+	if (node->type == Transform) {
+		TransformNode* trans_node = (TransformNode*) node;
+		// The first occurrence in this build gives the node its handle
+		if (!contains(trans_node)) {
+			uint32_t previous = trans_node->transform;
+			bool had_handle = previous < previous_owners.size() && previous_owners[previous] == trans_node;
+			trans_node->transform = (uint32_t) local.size();
+			local.push_back(had_handle ? previous_local[previous] : trans_node->matrix);
+			owners.push_back(trans_node);
+			local_bounds.push_back(empty_sphere);
+		}
+		occurrence = (int32_t) handles.size();
+		handles.push_back(trans_node->transform);
+		parents.push_back(parent);
+		ends.push_back(0);
+		parent = occurrence;
+	} else if (node->type == Geometry && parent >= 0) {
+		GeometryNode* geom_node = (GeometryNode*) node;
+		BoundingSphere sphere;
+		for (int i = 0; i < 3; i++) {
+			sphere.center[i] = geom_node->sphere_center[i];
+		}
+		sphere.radius = geom_node->radius;
+		BoundingSphere& node_bounds = local_bounds[handles[parent]];
+		node_bounds = merge(node_bounds, sphere);
+	}
+	for (std::vector<Node*>::iterator it = node->children.begin(); it != node->children.end(); ++it) {
+		add(*it, parent, previous_local, previous_owners);
+	}
+	if (occurrence >= 0) {
+		ends[occurrence] = (uint32_t) handles.size();
+	}
+}
+
+// Parents come before their children, so going forward their world matrix is always up to date,
+// and going backward the bounds of the children are
+void TransformStore::updateRange(size_t first, size_t end) {
+	for (size_t i = first; i < end; i++) {
+		const glm::mat4& local_matrix = local[handles[i]];
+		if (parents[i] < 0) {
+			worlds[i] = local_matrix;
+		} else {
+			multiply(glm::value_ptr(worlds[parents[i]]), glm::value_ptr(local_matrix),
+					glm::value_ptr(worlds[i]));
+		}
+	}
+	for (size_t i = end; i > first; i--) {
+		updateBounds(i - 1);
+	}
+}
+
+void TransformStore::updateBounds(size_t occurrence) {
+	BoundingSphere sphere = transformSphere(glm::value_ptr(worlds[occurrence]), local_bounds[handles[occurrence]]);
+	// Skip from child to child over their subtrees
+	for (size_t child = occurrence + 1; child < ends[occurrence]; child = ends[child]) {
+		sphere = merge(sphere, world_bounds[child]);
+	}
+	world_bounds[occurrence] = sphere;
+}
+
+void TransformStore::update() {
+	if (dirty.empty()) {
+		return;
+	}
+	std::sort(dirty.begin(), dirty.end());
+	dirty_ancestors.clear();
+	size_t updated_end = 0;
+	for (size_t d = 0; d < dirty.size(); d++) {
+		uint32_t occurrence = dirty[d];
+		// Already updated with the subtree of an earlier occurrence
+		if (occurrence < updated_end) {
+			continue;
+		}
+		updated_end = ends[occurrence];
+		updateRange(occurrence, updated_end);
+		for (int32_t p = parents[occurrence]; p >= 0; p = parents[p]) {
+			dirty_ancestors.push_back(p);
+		}
+	}
+	// The bounds of the ancestors grow or shrink with their subtrees, deepest first
+	std::sort(dirty_ancestors.begin(), dirty_ancestors.end(), std::greater<int32_t>());
+	dirty_ancestors.erase(std::unique(dirty_ancestors.begin(), dirty_ancestors.end()), dirty_ancestors.end());
+	for (size_t a = 0; a < dirty_ancestors.size(); a++) {
+		updateBounds(dirty_ancestors[a]);
+	}
+	dirty.clear();
+}
+
+void TransformStore::setLocal(uint32_t handle, const glm::mat4& matrix) {
+	assert(contains(handle));
+	local[handle] = matrix;
+	if (handle + 1 < occurrence_offsets.size()) {
+		for (uint32_t i = occurrence_offsets[handle]; i < occurrence_offsets[handle + 1]; i++) {
+			dirty.push_back(occurrence_list[i]);
+		}
+	}
+}
+
+const glm::mat4& TransformStore::getLocal(uint32_t handle) const {
+	assert(contains(handle));
+	return local[handle];
+}
+
+size_t TransformStore::size() const {
+	return handles.size();
+}
+
+uint32_t TransformStore::handle(size_t occurrence) const {
+	return handles[occurrence];
+}
+
+const glm::mat4& TransformStore::world(size_t occurrence) const {
+	return worlds[occurrence];
+}
+
+size_t TransformStore::subtreeEnd(size_t occurrence) const {
+	return ends[occurrence];
+}
+
+const BoundingSphere& TransformStore::bounds(size_t occurrence) const {
+	return world_bounds[occurrence];
+}
+
+bool TransformStore::contains(uint32_t handle) const {
+	return handle < local.size();
+}
+
+bool TransformStore::contains(const TransformNode* node) const {
+	return node->transform < owners.size() && owners[node->transform] == node;
+}
@@ -0,0 +1,124 @@
+// Copyright (C) 2017 Chris Liebert
+
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+#include "graphics/vertex_packing.h"
+
+GLushort floatToHalf(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t float_exponent = (bits >> 23) & 0xFF;
+	uint32_t mantissa = bits & 0x7FFFFF;
+	if (float_exponent == 0xFF) {
+		// Infinity and NaN
+		return (GLushort) (sign | 0x7C00 | (mantissa ? 0x200 : 0));
+	}
+	int exponent = (int) float_exponent - 127 + 15;
+	if (exponent >= 31) {
+		return (GLushort) (sign | 0x7C00);
+	}
+	if (exponent <= 0) {
+		// Subnormal half, or zero when it is too small
+		if (exponent < -10) {
+			return (GLushort) sign;
+		}
+		mantissa |= 0x800000;
+		uint32_t shift = (uint32_t) (14 - exponent);
+		uint32_t half = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1))) {
+			half++;
+		}
+		return (GLushort) (sign | half);
+	}
+	uint32_t half = ((uint32_t) exponent << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1FFF;
+	// Round to nearest even, a carry correctly rolls over into the exponent
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+		half++;
+	}
+	return (GLushort) (sign | half);
+}
+
+float halfToFloat(GLushort value) {
+	uint32_t sign = ((uint32_t) value & 0x8000) << 16;
+	uint32_t exponent = (value >> 10) & 0x1F;
+	uint32_t mantissa = value & 0x3FF;
+	uint32_t bits;
+	if (exponent == 0) {
+		if (mantissa == 0) {
+			bits = sign;
+		} else {
+			// Normalize the subnormal half
+			exponent = 127 - 15 + 1;
+			while (!(mantissa & 0x400)) {
+				mantissa <<= 1;
+				exponent--;
+			}
+			mantissa &= 0x3FF;
+			bits = sign | (exponent << 23) | (mantissa << 13);
+		}
+	} else if (exponent == 31) {
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	} else {
+		bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	}
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+GLshort floatToSnorm16(float v) {
+	if (v > 1.f) {
+		v = 1.f;
+	} else if (v < -1.f) {
+		v = -1.f;
+	}
+	float scaled = v * 32767.f;
+	return (GLshort) (scaled >= 0.f ? scaled + 0.5f : scaled - 0.5f);
+}
+
+float snorm16ToFloat(GLshort v) {
+	float f = (float) v / 32767.f;
+	return f < -1.f ? -1.f : f;
+}
+
+static inline float signNotZero(float v) {
+	return v >= 0.f ? 1.f : -1.f;
+}
+
+void octEncode(const float normal[3], GLshort encoded[2]) {
+	float l1 = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+	float x = 0.f, y = 0.f;
+	if (l1 > 0.f) {
+		x = normal[0] / l1;
+		y = normal[1] / l1;
+	}
+	// The lower hemisphere is folded over the diagonals
+	if (normal[2] < 0.f) {
+		float folded_x = (1.f - fabsf(y)) * signNotZero(x);
+		y = (1.f - fabsf(x)) * signNotZero(y);
+		x = folded_x;
+	}
+	encoded[0] = floatToSnorm16(x);
+	encoded[1] = floatToSnorm16(y);
+}
+
+void octDecode(const GLshort encoded[2], float normal[3]) {
+	float x = snorm16ToFloat(encoded[0]);
+	float y = snorm16ToFloat(encoded[1]);
+	float z = 1.f - fabsf(x) - fabsf(y);
+	if (z < 0.f) {
+		float folded_x = (1.f - fabsf(y)) * signNotZero(x);
+		y = (1.f - fabsf(x)) * signNotZero(y);
+		x = folded_x;
+	}
+	float length = sqrtf(x * x + y * y + z * z);
+	normal[0] = x / length;
+	normal[1] = y / length;
+	normal[2] = z / length;
+}
@@ -1,15 +1,27 @@
 // Copyright (C) 2017 Chris Liebert
 
+#include <algorithm>
+
 #include "common/asset_manager.hpp"
+#include "common/flat_index_map.hpp"
+#include "common/hash.hpp"
 #include "common/log.h"
+#include "graphics/bounds.h"
+#include "graphics/mesh_clusters.h"
+#include "graphics/mesh_optimizer.h"
+#include "graphics/mesh_simplifier.h"
 #include "graphics/wavefront_factory.h"
 
 #include "rapidxml.hpp"
 #include "rapidxml_utils.hpp"
 #include "rapidxml_print.hpp"
 
-WavefrontSceneGraphFactory::WavefrontSceneGraphFactory() {
+WavefrontSceneGraphFactory::WavefrontSceneGraphFactory(const std::string& cache_directory, ThreadPool* _pool,
+		SceneArena* _arena)
+: mesh_cache(cache_directory), pool(_pool), arena(_arena) {
 	start_position = 0;
+	vertex_format = FloatVertexFormat;
+	streaming_threshold = WAVEFRONT_STREAMING_THRESHOLD;
 }
 
 WavefrontSceneGraphFactory::~WavefrontSceneGraphFactory() {
@@ -58,6 +70,7 @@ void calcNormal(float N[3], float v0[3], float v1[3], float v2[3]) {
 
 		N[0] /= len;
 		N[1] /= len;
+		N[2] /= len;
 	}
 }
 
@@ -83,52 +96,225 @@ void replaceSubStr(string& source, const char* it, const char* with) {
 	replaceSubStr(source, its, withs);
 }
 
-class MaterialStringStreamReader : public tinyobj::MaterialReader {
-public:
-	MaterialStringStreamReader(const std::string& _mat_sstream)
-	: mat_sstream(_mat_sstream) {}
-	virtual ~MaterialStringStreamReader() {}
-	virtual bool operator()(const std::string& mat_id,
-			std::vector<tinyobj::material_t>* materials,
-			std::map<std::string, int>* mat_map,
-			std::string* err) {
-		(void)mat_id;
-		std::string warning;
-		tinyobj::LoadMtl(mat_map, materials, &mat_sstream, &warning);
-
-		if (!warning.empty()) {
-			if (err) {
-				(*err) += warning;
-			}
-		}
-		return true;
+// Hashes the attribute index triplet of a face corner
+struct IndexTripletHash {
+	uint64_t operator()(const wavefront::Index& index) const {
+		uint64_t key = ((uint64_t) (uint32_t) index.vertex_index << 32) | (uint32_t) index.normal_index;
+		return mix64(key ^ mix64((uint32_t) index.texcoord_index));
+	}
+};
+
+struct IndexTripletEqual {
+	bool operator()(const wavefront::Index& a, const wavefront::Index& b) const {
+		return a.vertex_index == b.vertex_index && a.normal_index == b.normal_index
+				&& a.texcoord_index == b.texcoord_index;
 	}
+};
 
-private:
-	std::stringstream mat_sstream;
+struct VertexHash {
+	uint64_t operator()(const Vertex& vertex) const {
+		return murmur64(&vertex, sizeof(Vertex));
+	}
 };
 
-// Find all the .mtl files included in a wavefront .obj source
-std::vector<std::string> getMTLFilenames(const std::string& obj_contents) {
-	std::vector<std::string> filenames;
-	std::stringstream ss(obj_contents);
-	std::string line;
-	while(std::getline(ss, line, '\n')) {
-		size_t pos = line.find("mtllib ");
-		if( pos != string::npos) {
-			std::string mtl_filename = line.substr(pos+7);
-			// Strip spaces and \r
-			replaceSubStr(mtl_filename, " ", "");
-			replaceSubStr(mtl_filename, "\r", "");
-			// Strip comments
-			size_t comment_pos = mtl_filename.find("#");
-			if(comment_pos != string::npos) {
-				mtl_filename = mtl_filename.substr(0, comment_pos);
+struct VertexEqual {
+	bool operator()(const Vertex& a, const Vertex& b) const {
+		return a == b;
+	}
+};
+
+// Position and texture coordinates of a face corner. The parser drops faces with indices out of
+// range, a corner that still has one is placed at the origin.
+static void fetchVertex(const wavefront::Attrib& attrib, const wavefront::Index& index, Vertex& vert) {
+	bool valid = index.vertex_index >= 0 && attrib.vertices.size() > 3 * (size_t) index.vertex_index + 2;
+	for (int k = 0; k < 3; k++) {
+		vert.position[k] = valid ? attrib.vertices[3 * index.vertex_index + k] : 0.f;
+	}
+	if (index.texcoord_index >= 0 && attrib.texcoords.size() > 2 * (size_t) index.texcoord_index + 1) {
+		vert.texcoord[0] = attrib.texcoords[2 * index.texcoord_index];
+		vert.texcoord[1] = 1.0f - attrib.texcoords[2 * index.texcoord_index + 1];
+	} else {
+		vert.texcoord[0] = 0.f;
+		vert.texcoord[1] = 0.f;
+	}
+}
+
+// True when every corner refers to a normal that was parsed
+static bool hasNormals(const wavefront::Attrib& attrib, const std::vector<wavefront::Index>& indices,
+		size_t num_corners) {
+	size_t num_normals = attrib.normals.size() / 3;
+	for (size_t i = 0; i < num_corners; i++) {
+		if (indices[i].normal_index < 0 || (size_t) indices[i].normal_index >= num_normals) {
+			return false;
+		}
+	}
+	return num_corners > 0;
+}
+
+// Sorts the triangles by material, stably, and records a submesh for each material.
+// material_ids refer to materials from first_material on.
+static void groupByMaterial(GeometryNode* geom_node, const std::vector<int>& material_ids,
+		const std::vector<MaterialNode*>& materials, size_t first_material) {
+	std::vector<GLuint>& indices = geom_node->index_data;
+	size_t num_triangles = indices.size() / 3;
+	// Submeshes are numbered in order of the first triangle using their material
+	std::map<int, GLuint> material_submesh;
+	std::vector<GLuint> triangle_submesh(num_triangles);
+	std::vector<GLuint> submesh_triangles;
+	geom_node->materials.clear();
+	for (size_t t = 0; t < num_triangles; t++) {
+		int material = t < material_ids.size() ? material_ids[t] : -1;
+		if (material < 0 || first_material + material >= materials.size()) {
+			material = -1;
+		}
+		std::map<int, GLuint>::iterator it = material_submesh.find(material);
+		if (it == material_submesh.end()) {
+			it = material_submesh.insert(std::make_pair(material, (GLuint) submesh_triangles.size())).first;
+			submesh_triangles.push_back(0);
+			geom_node->materials.push_back(material < 0 ? (MaterialNode*) 0 : materials[first_material + material]);
+		}
+		triangle_submesh[t] = it->second;
+		submesh_triangles[it->second]++;
+	}
+	geom_node->submeshes.clear();
+	std::vector<GLuint> next_triangle(submesh_triangles.size());
+	GLuint first_triangle = 0;
+	for (size_t m = 0; m < submesh_triangles.size(); m++) {
+		SubMesh submesh;
+		submesh.material = (GLuint) m;
+		submesh.first_index = 3 * first_triangle;
+		submesh.index_count = 3 * submesh_triangles[m];
+		geom_node->submeshes.push_back(submesh);
+		next_triangle[m] = first_triangle;
+		first_triangle += submesh_triangles[m];
+	}
+	if (geom_node->submeshes.size() < 2) {
+		return;
+	}
+	std::vector<GLuint> sorted(indices.size());
+	for (size_t t = 0; t < num_triangles; t++) {
+		GLuint to = next_triangle[triangle_submesh[t]]++;
+		for (int c = 0; c < 3; c++) {
+			sorted[3 * to + c] = indices[3 * t + c];
+		}
+	}
+	indices.swap(sorted);
+}
+
+// Expands, centers and welds the triangles of one shape, returns 0 when the shape has no geometry.
+// The face corners of the shape are freed once they are welded. The face material ids refer to
+// materials from first_material on.
+static GeometryNode* buildGeometryNode(const wavefront::Attrib& attrib, wavefront::Shape& shape,
+		const std::vector<MaterialNode*>& materials, size_t first_material, VertexFormat vertex_format, SceneArena* arena,
+		size_t& duplicates_removed, VertexCacheStatistics& before, VertexCacheStatistics& after) {
+	const std::vector<wavefront::Index>& indices = shape.mesh.indices;
+	size_t num_corners = indices.size() - indices.size() % 3;
+	if (num_corners == 0) {
+		// Ignore scene nodes that don't have geometry
+		LOGI(
+				"Warning, scene node %s does not containing geometry, ommiting.",
+				shape.name.c_str()
+		);
+		return 0;
+	}
+	GeometryNode* geom_node = createNode<GeometryNode>(arena);
+	geom_node->setName(shape.name);
+	geom_node->index_data.reserve(num_corners);
+	// The center is the mean of all face corners
+	double center[3] = { 0.0, 0.0, 0.0 };
+
+	if (hasNormals(attrib, indices, num_corners)) {
+		// Corners with the same attribute indices are the same vertex
+		FlatIndexMap<wavefront::Index, IndexTripletHash, IndexTripletEqual> unique_corners(num_corners);
+		for (size_t i = 0; i < num_corners; i++) {
+			const wavefront::Index& index = indices[i];
+			bool inserted;
+			GLuint vindex = unique_corners.insert(index, inserted);
+			if (inserted) {
+				Vertex vert;
+				fetchVertex(attrib, index, vert);
+				for (int k = 0; k < 3; k++) {
+					vert.normal[k] = attrib.normals[3 * index.normal_index + k];
+				}
+				geom_node->vertex_data.push_back(vert);
+			}
+			const Vertex& vert = geom_node->vertex_data[vindex];
+			for (int k = 0; k < 3; k++) {
+				center[k] += vert.position[k];
 			}
-			filenames.push_back(mtl_filename);
+			geom_node->index_data.push_back(vindex);
+		}
+	} else {
+		// Generated face normals are part of the vertex, so whole vertices are compared
+		FlatIndexMap<Vertex, VertexHash, VertexEqual> unique_vertices(num_corners);
+		for (size_t f = 0; f < num_corners; f += 3) {
+			Vertex verts[3];
+			for (int c = 0; c < 3; c++) {
+				fetchVertex(attrib, indices[f + c], verts[c]);
+			}
+			// compute geometric normal
+			calcNormal(verts[0].normal, verts[0].position, verts[1].position, verts[2].position);
+			for (int c = 0; c < 3; c++) {
+				for (int k = 0; k < 3; k++) {
+					verts[c].normal[k] = verts[0].normal[k];
+					center[k] += verts[c].position[k];
+				}
+				bool inserted;
+				GLuint vindex = unique_vertices.insert(verts[c], inserted);
+				if (inserted) {
+					geom_node->vertex_data.push_back(verts[c]);
+				}
+				geom_node->index_data.push_back(vindex);
+			}
+		}
+	}
+	duplicates_removed = num_corners - geom_node->vertex_data.size();
+	std::vector<wavefront::Index>().swap(shape.mesh.indices);
+	groupByMaterial(geom_node, shape.mesh.material_ids, materials, first_material);
+	std::vector<int>().swap(shape.mesh.material_ids);
+
+	for (int k = 0; k < 3; k++) {
+		geom_node->center[k] = (float) (center[k] / (double) num_corners);
+	}
+
+	// Now that the center is calculated, it is subtracted from the individual vertices.
+	for (std::vector<Vertex>::iterator it = geom_node->vertex_data.begin(); it != geom_node->vertex_data.end(); ++it) {
+		Vertex* vert = &*it;
+		for (int xyz = 0; xyz < 3; xyz++) {
+			vert->position[xyz] -= geom_node->center[xyz];
 		}
 	}
-	return filenames;
+
+	computeBounds(geom_node);
+	if (geom_node->radius <= 0.f) {
+		geom_node->radius = 0.1f;
+	}
+	// Reorder each submesh for the post-transform cache, then for overdraw, then the vertices for fetching
+	analyzeVertexCache(geom_node->index_data, geom_node->vertex_data.size(), before);
+	if (geom_node->submeshes.size() > 1) {
+		for (size_t m = 0; m < geom_node->submeshes.size(); m++) {
+			std::vector<GLuint>::iterator first = geom_node->index_data.begin() + geom_node->submeshes[m].first_index;
+			std::vector<GLuint> submesh_indices(first, first + geom_node->submeshes[m].index_count);
+			optimizeVertexCache(submesh_indices, geom_node->vertex_data.size());
+			optimizeOverdraw(submesh_indices, geom_node->vertex_data);
+			std::copy(submesh_indices.begin(), submesh_indices.end(), first);
+		}
+	} else {
+		optimizeVertexCache(geom_node->index_data, geom_node->vertex_data.size());
+		optimizeOverdraw(geom_node->index_data, geom_node->vertex_data);
+	}
+	optimizeVertexFetch(geom_node->index_data, geom_node->vertex_data);
+	analyzeVertexCache(geom_node->index_data, geom_node->vertex_data.size(), after);
+	buildClusters(geom_node);
+	// The simplified levels are appended after the full detail indices
+	generateLods(geom_node);
+
+	// Last stages, everything above works on 32-bit indices and float vertices
+	geom_node->compactIndices();
+	if (vertex_format == PackedVertexFormat) {
+		geom_node->packVertices();
+	}
+	return geom_node;
 }
 
 bool WavefrontSceneGraphFactory::addWavefront(const char* file_name, glm::mat4 matrix, AssetManager* asset_manager) {
@@ -143,43 +329,131 @@ bool WavefrontSceneGraphFactory::addWavefront(const char* file_name, glm::mat4 m
 
 	size_t initial_num_materials = this->materials.size();
 	size_t total_duplicates_removed = 0;
-	tinyobj::attrib_t attrib;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> material_list;
-	std::string err;
-	std::stringstream obj_stream;
-	std::stringstream mat_stream;
-	const std::string obj_contents = asset_manager->loadTextFile(file_name);
-	std::vector<std::string> mtl_filenames = getMTLFilenames(obj_contents);
-	obj_stream << obj_contents;
-	for(std::vector<std::string>::iterator it = mtl_filenames.begin(); it != mtl_filenames.end(); ++it) {
-		std::string mtl_filename = *it;
-		std::string mtl_contents = asset_manager->loadTextFile(mtl_filename.c_str());
-		mat_stream << mtl_contents;
-	}
-	const std::string mtls_contents = mat_stream.str();
-	MaterialStringStreamReader mat_ss_reader(mtls_contents);
-	bool ret = tinyobj::LoadObj(&attrib, &shapes, &material_list, &err, &obj_stream, &mat_ss_reader);
-	if(!ret) {
+	AssetView obj_view;
+	if(!asset_manager->mapAsset(file_name, obj_view)) {
 		return false;
 	}
+	if(obj_view.size() >= streaming_threshold) {
+		return addWavefrontStreaming(file_name, obj_view, asset_manager);
+	}
 	std::stringstream file_name_path;
 	file_name_path << file_name;
 	std::stringstream namess;
 	namess << name << "[" << file_name_path.str() << "]";
 	this->name = namess.str();
-	if (!err.empty()) {
-		LOGE("%s\n", err.c_str());
+
+	// Only the mtllib lines are read before the cache is probed, the file is parsed on a miss
+	std::vector<std::string> mtllibs;
+	wavefront::scanMtllibs(obj_view.chars(), obj_view.size(), mtllibs);
+	// Request all material files before waiting for any of them
+	for(std::vector<std::string>::iterator it = mtllibs.begin(); it != mtllibs.end(); ++it) {
+		asset_manager->loadAsync(it->c_str());
+	}
+	// The cache key covers everything the processed mesh depends on
+	uint64_t cache_key = murmur64(obj_view.data(), obj_view.size(), MESH_CACHE_VERSION);
+	cache_key = mix64(cache_key ^ (uint64_t) vertex_format);
+	// The material files stay mapped to be parsed on a miss
+	std::vector<AssetView> mtl_views(mtllibs.size());
+	std::vector<bool> mtl_mapped(mtllibs.size(), false);
+	for(size_t i = 0; i < mtllibs.size(); i++) {
+		if(asset_manager->mapAsset(mtllibs[i].c_str(), mtl_views[i])) {
+			mtl_mapped[i] = true;
+			cache_key = murmur64(mtl_views[i].data(), mtl_views[i].size(), cache_key);
+		}
+	}
+	CachedMesh cached_mesh;
+	if (mesh_cache.load(cache_key, cached_mesh, arena)) {
+		addCachedMesh(cached_mesh);
+		LOGI("Loaded %s from the mesh cache", file_name);
+		return true;
+	}
+
+	// The obj file is parsed straight from the mapped asset
+	wavefront::ObjData obj;
+	if(!wavefront::parseObj(obj_view.chars(), obj_view.size(), obj, pool)) {
+		LOGE("Unable to parse %s", file_name);
 		return false;
 	}
+	obj_view.release();
+	if (obj.invalid_faces > 0) {
+		LOGE("Skipped %i faces with invalid indices in %s", (int) obj.invalid_faces, file_name);
+	}
+	wavefront::Attrib& attrib = obj.attrib;
+	std::vector<wavefront::Shape>& shapes = obj.shapes;
+	std::vector<wavefront::Material> material_list;
+	std::map<std::string, int> material_map;
+	for(size_t i = 0; i < mtllibs.size(); i++) {
+		if(mtl_mapped[i]) {
+			wavefront::parseMtl(mtl_views[i].chars(), mtl_views[i].size(), material_list, material_map);
+		} else {
+			LOGE("Unable to load material file %s", mtllibs[i].c_str());
+		}
+	}
+	mtl_views.clear();
+	wavefront::resolveMaterials(obj, material_map);
+
+	size_t initial_num_geometry_nodes = geometry_nodes.size();
+
+	addMaterials(material_list, 0);
+
+	// Shapes are independent, they are built in parallel and added in file order
+	std::vector<GeometryNode*> shape_nodes(shapes.size(), (GeometryNode*) 0);
+	std::vector<size_t> shape_duplicates(shapes.size(), 0);
+	std::vector<VertexCacheStatistics> shape_cache_before(shapes.size()), shape_cache_after(shapes.size());
+	VertexFormat format = vertex_format;
+	if (pool && shapes.size() > 1) {
+		std::vector<std::future<void> > built;
+		for (size_t s = 0; s < shapes.size(); s++) {
+			built.push_back(pool->submit([this, &attrib, &shapes, &shape_nodes, &shape_duplicates, &shape_cache_before,
+					&shape_cache_after, initial_num_materials, format, s]() {
+				shape_nodes[s] = buildGeometryNode(attrib, shapes[s], materials, initial_num_materials, format, arena,
+						shape_duplicates[s], shape_cache_before[s], shape_cache_after[s]);
+			}));
+		}
+		// Every task refers to this frame, so all of them finish before any error is rethrown
+		for (size_t s = 0; s < built.size(); s++) {
+			built[s].wait();
+		}
+		for (size_t s = 0; s < built.size(); s++) {
+			built[s].get();
+		}
+	} else {
+		for (size_t s = 0; s < shapes.size(); s++) {
+			shape_nodes[s] = buildGeometryNode(attrib, shapes[s], materials, initial_num_materials, format, arena,
+					shape_duplicates[s], shape_cache_before[s], shape_cache_after[s]);
+		}
+	}
+
+	VertexCacheStatistics cache_before, cache_after;
+	for (size_t s = 0; s < shapes.size(); s++) {
+		GeometryNode* geom_node = shape_nodes[s];
+		if (!geom_node) {
+			continue;
+		}
+		total_duplicates_removed += shape_duplicates[s];
+		cache_before.add(shape_cache_before[s]);
+		cache_after.add(shape_cache_after[s]);
+
+		associateMaterial(geom_node, initial_num_materials);
+		geometry_nodes.push_back(geom_node);
+	}
 
-	if (!ret) {
+	if (geometry_nodes.size() == 0) {
+		LOGE("Error: No scene nodes defined in %s", file_name);
 		return false;
 	}
 
-	// load diffuse textures
-	for (size_t mi = 0; mi < material_list.size(); mi++) {
-		tinyobj::material_t* mp = &material_list[mi];
+	LOGI("removed %i duplicate vertices from %s", (int)total_duplicates_removed, file_name);
+	LOGI("vertex cache ACMR %.3f -> %.3f, ATVR %.3f -> %.3f in %s", cache_before.acmr(), cache_after.acmr(),
+			cache_before.atvr(), cache_after.atvr(), file_name);
+	saveCachedMesh(cache_key, initial_num_materials, initial_num_geometry_nodes);
+	return true;
+}
+
+// Creates the material nodes of material_list from first on and loads their diffuse textures
+void WavefrontSceneGraphFactory::addMaterials(std::vector<wavefront::Material>& material_list, size_t first) {
+	for (size_t mi = first; mi < material_list.size(); mi++) {
+		wavefront::Material* mp = &material_list[mi];
 		if (mp->diffuse_texname.length() > 0) {
 			// Check for paths that are not valid (unix support for paths with \ or \\ instead of /
 #ifndef _MSC_VER
@@ -189,212 +463,124 @@ bool WavefrontSceneGraphFactory::addWavefront(const char* file_name, glm::mat4 m
 			addTexture(mp->diffuse_texname.c_str());
 		}
 
-		MaterialNode* mat_node = new MaterialNode();
-		assert(mat_node);
-		mat_node->name = mp->name;
+		MaterialNode* mat_node = createNode<MaterialNode>(arena);
+		mat_node->setName(mp->name);
 		mat_node->diffuse_texture = mp->diffuse_texname;
 		materials.push_back(mat_node);
 	}
+}
 
-	// Load data
-	std::vector<Vertex> vertices;
-	for (size_t s = 0; s < shapes.size(); s++) {
-		GeometryNode* geom_node = new GeometryNode();
-		assert(geom_node);
-		geom_node->center[0] = 0.f;
-		geom_node->center[1] = 0.f;
-		geom_node->center[2] = 0.f;
-
-		for (size_t f = 0; f < shapes[s].mesh.indices.size() / 3; f++) {
-			tinyobj::index_t idx0 = shapes[s].mesh.indices[3 * f + 0];
-			tinyobj::index_t idx1 = shapes[s].mesh.indices[3 * f + 1];
-			tinyobj::index_t idx2 = shapes[s].mesh.indices[3 * f + 2];
-			int current_material_id = shapes[s].mesh.material_ids[f];
-			if ((current_material_id < 0)
-					|| (current_material_id >= material_list.size())) {
-				// Invalid material ID. Use default material.
-				current_material_id = (int) material_list.size(); // Default material is added to the last item in `materialList`.
-				LOGE(
-						"Invalid material index: %i reverting to default material.",
-						current_material_id);
-			}
-
-			float diffuse[3];
-			for (size_t i = 0; i < 3; i++) {
-				diffuse[i] = material_list[current_material_id].diffuse[i];
-			}
-
-			float tc[3][2];
-			if (attrib.texcoords.size() > 2 * idx0.texcoord_index + 1) {
-				tc[0][0] = attrib.texcoords[2 * idx0.texcoord_index];
-				tc[0][1] = 1.0f
-						- attrib.texcoords[2 * idx0.texcoord_index + 1];
-			} else {
-				tc[0][0] = 0.f;
-				tc[0][1] = 0.f;
-			}
-			if (attrib.texcoords.size() > 2 * idx1.texcoord_index + 1) {
-				tc[1][0] = attrib.texcoords[2 * idx1.texcoord_index];
-				tc[1][1] = 1.0f
-						- attrib.texcoords[2 * idx1.texcoord_index + 1];
-			} else {
-				tc[1][0] = 0.f;
-				tc[1][1] = 0.f;
-			}
-			if (attrib.texcoords.size() > 2 * idx2.texcoord_index + 1) {
-				tc[2][0] = attrib.texcoords[2 * idx2.texcoord_index];
-				tc[2][1] = 1.0f
-						- attrib.texcoords[2 * idx2.texcoord_index + 1];
-			} else {
-				tc[2][0] = 0.f;
-				tc[2][1] = 0.f;
-			}
-
-			float v[3][3];
-			for (int k = 0; k < 3; k++) {
-				int f0 = idx0.vertex_index;
-				int f1 = idx1.vertex_index;
-				int f2 = idx2.vertex_index;
-				assert(f0 >= 0);
-				assert(f1 >= 0);
-				assert(f2 >= 0);
-				v[0][k] = attrib.vertices[3 * f0 + k];
-				v[1][k] = attrib.vertices[3 * f1 + k];
-				v[2][k] = attrib.vertices[3 * f2 + k];
-			}
+// Builds each shape as soon as the parser has seen all of its faces, the mesh cache is not used
+// because the key depends on material files that are only known once the whole file is parsed
+bool WavefrontSceneGraphFactory::addWavefrontStreaming(const char* file_name, AssetView& obj_view,
+		AssetManager* asset_manager) {
+	size_t initial_num_materials = materials.size();
+	size_t initial_num_geometry_nodes = geometry_nodes.size();
+	std::vector<wavefront::Material> material_list;
+	std::map<std::string, int> material_map;
+	size_t num_mtllibs = 0;
+	size_t total_duplicates_removed = 0;
+	VertexCacheStatistics cache_before, cache_after;
+	std::stringstream namess;
+	namess << name << "[" << file_name << "]";
+	this->name = namess.str();
 
-			float n[3][3];
-			if (attrib.normals.size() > 0) {
-				int f0 = idx0.normal_index;
-				int f1 = idx1.normal_index;
-				int f2 = idx2.normal_index;
-				assert(f0 >= 0);
-				assert(f1 >= 0);
-				assert(f2 >= 0);
-				for (int k = 0; k < 3; k++) {
-					n[0][k] = attrib.normals[3 * f0 + k];
-					n[1][k] = attrib.normals[3 * f1 + k];
-					n[2][k] = attrib.normals[3 * f2 + k];
-				}
+	wavefront::ObjData obj;
+	wavefront::parseObjStreaming(obj_view.chars(), obj_view.size(), obj,
+			[&](wavefront::ObjData& parsed, wavefront::Shape& shape) {
+		// Material files listed before the end of the shape are read before it is built
+		for (; num_mtllibs < parsed.mtllibs.size(); num_mtllibs++) {
+			AssetView mtl_view;
+			size_t first_material = material_list.size();
+			if (asset_manager->mapAsset(parsed.mtllibs[num_mtllibs].c_str(), mtl_view)) {
+				wavefront::parseMtl(mtl_view.chars(), mtl_view.size(), material_list, material_map);
+				addMaterials(material_list, first_material);
 			} else {
-				// compute geometric normal
-				calcNormal(n[0], v[0], v[1], v[2]);
-				n[1][0] = n[0][0];
-				n[1][1] = n[0][1];
-				n[1][2] = n[0][2];
-				n[2][0] = n[0][0];
-				n[2][1] = n[0][1];
-				n[2][2] = n[0][2];
-			}
-
-			for (int k = 0; k < 3; k++) {
-				Vertex vert;
-				vert.position[0] = v[k][0];
-				vert.position[1] = v[k][1];
-				vert.position[2] = v[k][2];
-				vert.normal[0] = n[k][0];
-				vert.normal[1] = n[k][1];
-				vert.normal[2] = n[k][2];
-				vert.texcoord[0] = tc[k][0];
-				vert.texcoord[1] = tc[k][1];
-
-				// local object center mean calculation (stage 1)
-				geom_node->center[0] += vert.position[0];
-				geom_node->center[1] += vert.position[1];
-				geom_node->center[2] += vert.position[2];
-
-				vertices.push_back(vert);
+				LOGE("Unable to load material file %s", parsed.mtllibs[num_mtllibs].c_str());
 			}
 		}
-
-		if (vertices.size() == 0) {
-			// Ignore scene nodes that don't have geometry
-			LOGI(
-					"Warning, scene node %s does not containing geometry, ommiting.",
-					shapes[s].name.c_str()
-			);
-			continue;
-		}
-
-		geom_node->name = shapes[s].name;
-		double num_vertices = (double) vertices.size();
-		// 2nd stage of mean calculation
-
-		geom_node->center[0] = (float)(geom_node->center[0] / num_vertices);
-		geom_node->center[1] = (float)(geom_node->center[1] / num_vertices);
-		geom_node->center[2] = (float)(geom_node->center[2] / num_vertices);
-
-		// Now that the center is calculated, it is subtracted from the individual vertices.
-		for (std::vector<Vertex>::iterator it = vertices.begin(); it != vertices.end(); ++it) {
-			Vertex* vert = &*it;
-			for (int xyz = 0; xyz < 3; xyz++) {
-				vert->position[xyz] -= geom_node->center[xyz];
-			}
-		}
-
-		geom_node->radius = 0.f;
-		// Radius calculation
-
-		for (size_t i = 0; i < vertices.size(); i++) {
-			float x = vertices.at(i).position[0];
-			float y = vertices.at(i).position[1];
-			float z = vertices.at(i).position[2];
-			float nx = x - geom_node->center[0];
-			float ny = y - geom_node->center[1];
-			float nz = z - geom_node->center[2];
-			float sum_of_squares = nx * nx + ny * ny + nz * nz;
-			if (sum_of_squares > 0.f) {
-				float r2 = sqrtf(sum_of_squares);
-				if (r2 > geom_node->radius) {
-					geom_node->radius = r2;
-				}
-			}
+		wavefront::resolveMaterials(shape, parsed.material_names, material_map);
+		size_t duplicates_removed;
+		VertexCacheStatistics before, after;
+		GeometryNode* geom_node = buildGeometryNode(parsed.attrib, shape, materials, initial_num_materials,
+				vertex_format, arena, duplicates_removed, before, after);
+		if (geom_node) {
+			total_duplicates_removed += duplicates_removed;
+			cache_before.add(before);
+			cache_after.add(after);
+			associateMaterial(geom_node, initial_num_materials);
+			geometry_nodes.push_back(geom_node);
 		}
+	}, pool);
+	if (obj.invalid_faces > 0) {
+		LOGE("Skipped %i faces with invalid indices in %s", (int) obj.invalid_faces, file_name);
+	}
 
-		if (geom_node->radius <= 0.f) {
-			geom_node->radius = 0.1f;
-		}
+	if (geometry_nodes.size() == initial_num_geometry_nodes) {
+		LOGE("Error: No scene nodes defined in %s", file_name);
+		return false;
+	}
+	LOGI("removed %i duplicate vertices from %s", (int)total_duplicates_removed, file_name);
+	LOGI("vertex cache ACMR %.3f -> %.3f, ATVR %.3f -> %.3f in %s", cache_before.acmr(), cache_after.acmr(),
+			cache_before.atvr(), cache_after.atvr(), file_name);
+	return true;
+}
 
-		// Reduce duplicated vertices, see https://vulkan-tutorial.com/Loading_models
-		std::unordered_map<Vertex, GLuint> unique_vertices;
+// Places a node below the material of its first submesh
+void WavefrontSceneGraphFactory::associateMaterial(GeometryNode* geom_node, size_t first_material) {
+	if (geom_node->materials.empty() || !geom_node->materials[0]) {
+		return;
+	}
+	std::vector<MaterialNode*>::iterator it = std::find(materials.begin() + first_material, materials.end(),
+			geom_node->materials[0]);
+	node_material_association[geom_node] = it - materials.begin();
+}
 
-		for(std::vector<Vertex>::iterator vit = vertices.begin(); vit != vertices.end(); ++vit) {
-			if(unique_vertices.find(*vit) == unique_vertices.end()) {
-				GLuint vindex = (GLuint) unique_vertices.size();
-				unique_vertices.insert(std::make_pair(*vit, vindex));
-				geom_node->vertex_data.push_back(*vit);
-			}
-			geom_node->index_data.push_back(unique_vertices[*vit]);
+// Take ownership of the nodes of a mesh loaded from the cache
+void WavefrontSceneGraphFactory::addCachedMesh(CachedMesh& mesh) {
+	size_t initial_num_materials = materials.size();
+	for (std::vector<MaterialNode*>::iterator it = mesh.materials.begin(); it != mesh.materials.end(); ++it) {
+		MaterialNode* mat_node = *it;
+		if (mat_node->diffuse_texture.length() > 0) {
+			addTexture(mat_node->diffuse_texture.c_str());
 		}
-
-		total_duplicates_removed += (vertices.size() - unique_vertices.size());
-
-		// Free up some memory
-		unique_vertices.clear();
-		vertices.clear();
-
-		if (shapes[s].mesh.material_ids.size() > 0
-				&& shapes[s].mesh.material_ids.size() > s) {
-			size_t node_mat_id = shapes[s].mesh.material_ids[s] + initial_num_materials;
-			node_material_association[geom_node] = node_mat_id;
+		materials.push_back(mat_node);
+	}
+	for (size_t i = 0; i < mesh.geometry_nodes.size(); i++) {
+		GeometryNode* geom_node = mesh.geometry_nodes[i];
+		if (mesh.geometry_materials[i] >= 0) {
+			node_material_association[geom_node] = initial_num_materials + mesh.geometry_materials[i];
 		}
-
 		geometry_nodes.push_back(geom_node);
 	}
+	mesh.materials.clear();
+	mesh.geometry_nodes.clear();
+	mesh.geometry_materials.clear();
+}
 
-	if (geometry_nodes.size() == 0) {
-		LOGE("Error: No scene nodes defined in %s", file_name);
-		return false;
+// Store the nodes added by the last call to addWavefront
+void WavefrontSceneGraphFactory::saveCachedMesh(uint64_t key, size_t first_material, size_t first_geometry_node) {
+	if (!mesh_cache.enabled()) {
+		return;
 	}
-
-	LOGI("removed %i duplicate vertices from %s", (int)total_duplicates_removed, file_name);
-	return true;
+	CachedMesh mesh;
+	mesh.materials.assign(materials.begin() + first_material, materials.end());
+	for (size_t i = first_geometry_node; i < geometry_nodes.size(); i++) {
+		GeometryNode* geom_node = geometry_nodes[i];
+		std::map<GeometryNode*, size_t>::iterator it = node_material_association.find(geom_node);
+		int material = -1;
+		if (it != node_material_association.end()) {
+			material = (int) (it->second - first_material);
+		}
+		mesh.geometry_nodes.push_back(geom_node);
+		mesh.geometry_materials.push_back(material);
+	}
+	mesh_cache.save(key, mesh);
 }
 
 Node* WavefrontSceneGraphFactory::build() {
-	Node* group = new Node();
-	assert(group);
-	group->name = std::string(name);
+	Node* group = createNode<Node>(arena);
+	group->setName(name);
 
 	for (std::vector<MaterialNode*>::iterator it = materials.begin(); it != materials.end(); ++it) {
 		MaterialNode* wfm = *it;
@@ -404,18 +590,16 @@ Node* WavefrontSceneGraphFactory::build() {
 	for (std::vector<GeometryNode*>::iterator it = this->geometry_nodes.begin(); it != this->geometry_nodes.end(); ++it) {
 		GeometryNode* geom_node = *it;
 		size_t mat_id = node_material_association[geom_node];
-		std::string mat_name = materials.at(mat_id)->name;
-		MaterialNode* mat_node = (MaterialNode*) group->find(mat_name);
-		// mat_node should have been added in the previous loop
+		// The material was added to the group in the previous loop
+		MaterialNode* mat_node = materials.at(mat_id);
 		assert(mat_node);
-		TransformNode* trans_node = new TransformNode();
-		assert(trans_node);
+		TransformNode* trans_node = createNode<TransformNode>(arena);
 		trans_node->matrix = glm::translate(glm::mat4(1.0f),
 				glm::vec3(geom_node->center[0], geom_node->center[1],
 						geom_node->center[2]));
 		trans_node->name = geom_node->name;
 		// Rename geometry node
-		geom_node->name = trans_node->name + std::string("_Geometry");
+		geom_node->setName(trans_node->getName() + std::string("_Geometry"));
 		trans_node->children.push_back(geom_node);
 		mat_node->children.push_back(trans_node);
 	}
@@ -212,7 +212,7 @@ int main(int argc, char** argv) {
 					if (renderer) { delete renderer; }
 					application = new Application();
 					assert(application);
-					renderer = new RENDERER(application->images);
+					renderer = new RENDERER();
 					assert(renderer);
 					reshapeFunc(window, width, height);
 					// Reset simulation time
@@ -46,13 +46,29 @@ Simulation::~Simulation() {
 	delete collision_configuration;
 }
 
-void Simulation::parseXMLNode(rapidxml::xml_node<>* my_xml_node, scenegraph::Node* scenegraph_root) {
+static TransformNode* findTransform(std::string& object_name, const scenegraph::NodeIndex& scene_index,
+		scenegraph::Node* placement) {
+	if (placement) {
+		return scenegraph::find_transform_node(object_name, placement);
+	}
+	return scene_index.findTransform(object_name);
+}
+
+void Simulation::parseXMLNode(rapidxml::xml_node<>* my_xml_node, const scenegraph::NodeIndex& scene_index,
+		const std::map<rapidxml::xml_node<>*, scenegraph::Node*>& placements, scenegraph::Node* placement) {
 	if (!my_xml_node)
 		return;
 	char* c_name = my_xml_node->name();
 	if (0 == strlen(c_name))
 		return;
 	std::string name(c_name);
+	// Names inside a model element refer to its own placement, other placements of the file
+	// have transform nodes of the same name
+	scenegraph::Node* child_placement = placement;
+	std::map<rapidxml::xml_node<>*, scenegraph::Node*>::const_iterator placed = placements.find(my_xml_node);
+	if (placed != placements.end()) {
+		child_placement = placed->second;
+	}
 	if (0 == std::string("PhysicsNode").compare(name)) {
 		float mass = 0.f;
 		float offset_x = 0.f;
@@ -102,7 +118,7 @@ void Simulation::parseXMLNode(rapidxml::xml_node<>* my_xml_node, scenegraph::Nod
 							offset_z = (float) atof(col_attr->value());
 						}
 					}
-					TransformNode* trans_node = scenegraph::find_transform_node(object_name, scenegraph_root);
+					TransformNode* trans_node = findTransform(object_name, scene_index, placement);
 					if (trans_node) {
 						addPhysicsBoxNode(trans_node, mass, width, height,
 								length, offset_x, offset_y, offset_z);
@@ -111,7 +127,7 @@ void Simulation::parseXMLNode(rapidxml::xml_node<>* my_xml_node, scenegraph::Nod
 						LOGI("%s was referenced in configuration, but not loaded", object_name.c_str());
 					}
 				} else if (0 == std::string("ConvexHull").compare(child->value())) {
-					TransformNode* trans_node = scenegraph::find_transform_node(object_name, scenegraph_root);
+					TransformNode* trans_node = findTransform(object_name, scene_index, placement);
 					if (trans_node) {
 						addPhysicsConvexHullNode(trans_node, mass);
 						break;
@@ -127,8 +143,8 @@ void Simulation::parseXMLNode(rapidxml::xml_node<>* my_xml_node, scenegraph::Nod
 	}
 
 	// Recursively parse children and siblings
-	parseXMLNode(my_xml_node->first_node(), scenegraph_root);
-	parseXMLNode(my_xml_node->next_sibling(), scenegraph_root);
+	parseXMLNode(my_xml_node->first_node(), scene_index, placements, child_placement);
+	parseXMLNode(my_xml_node->next_sibling(), scene_index, placements, placement);
 }
 
 void Simulation::addPhysicsNode(TransformNode* trans_node,
@@ -199,13 +215,16 @@ void Simulation::addPhysicsBoxNode(TransformNode* trans_node, float mass,
 void populateConvexHullShapeFromNode(scenegraph::Node* root, btConvexHullShape* convex_hull, glm::mat4& matrix) {
 	if(root->type == scenegraph::NodeType::Geometry) {
 		scenegraph::GeometryNode* geometry_node = (scenegraph::GeometryNode*) root;
-		for(std::vector<GLuint>::iterator index_it = geometry_node->index_data.begin(); index_it != geometry_node->index_data.end(); ++index_it) {
-			GLuint i = *index_it;
-			scenegraph::Vertex* v = &geometry_node->vertex_data[i];
+		// The hull only needs the full detail level
+		scenegraph::LodLevel full_detail = geometry_node->lod(0);
+		for(size_t index_i = full_detail.first_index; index_i < full_detail.first_index + full_detail.index_count; index_i++) {
+			GLuint i = geometry_node->index(index_i);
+			float position[3];
+			geometry_node->getPosition(i, position);
 			glm::vec4 v_trans = glm::vec4(
-					v->position[0],
-					v->position[1],
-					v->position[2],
+					position[0],
+					position[1],
+					position[2],
 					1.0f) * matrix;
 			convex_hull->addPoint(
 				btVector3(v_trans.x, v_trans.y, v_trans.z)
@@ -215,7 +234,7 @@ void populateConvexHullShapeFromNode(scenegraph::Node* root, btConvexHullShape*
 		scenegraph::TransformNode* transform_node = (scenegraph::TransformNode*) root;
 		matrix *= transform_node->matrix;
 	} else {
-		LOGE("Node type not implemented for trimesh %s", root->name.c_str());
+		LOGE("Node type not implemented for trimesh %s", root->getName().c_str());
 	}
 	for(std::vector<scenegraph::Node*>::iterator it = root->children.begin(); it != root->children.end(); ++it) {
 		scenegraph::Node* child = *it;
@@ -236,10 +255,20 @@ void Simulation::step() {
 	dynamics_world->stepSimulation(1.f / 60.f, 10);
 }
 
-void Simulation::applyForce(const std::string& rigid_body_name, const btVector3& force, const btVector3& rel_pos) {
-	std::map<std::string, btRigidBody*>::iterator itr = rigid_bodies.find(rigid_body_name);
+void Simulation::applyForce(NameId rigid_body_name, const btVector3& force, const btVector3& rel_pos) {
+	std::unordered_map<NameId, btRigidBody*>::iterator itr = rigid_bodies.find(rigid_body_name);
 	if(itr != rigid_bodies.end()) {
 		itr->second->applyForce(force, rel_pos);
+	} else {
+		LOGI("Unable to find rigid body called %s, can not apply force",
+				StringInterner::global().str(rigid_body_name).c_str());
+	}
+}
+
+void Simulation::applyForce(const std::string& rigid_body_name, const btVector3& force, const btVector3& rel_pos) {
+	NameId id;
+	if (StringInterner::global().lookup(rigid_body_name, id)) {
+		applyForce(id, force, rel_pos);
 	} else {
 		LOGI("Unable to find rigid body called %s, can not apply force", rigid_body_name.c_str());
 	}
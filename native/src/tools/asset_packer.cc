@@ -0,0 +1,95 @@
+// Copyright (C) 2017 Chris Liebert
+
+// Packs every file in a directory into a single asset pack, see common/asset_pack.hpp
+// usage: asset_packer <asset directory> <pack file>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "common/asset_pack.hpp"
+#include "common/asset_view.hpp"
+#include "common/log.h"
+
+// Collect file paths relative to root, directories are separated with '/'
+bool listFiles(const std::string& root, const std::string& relative_path, std::vector<std::string>& files) {
+	std::string directory = relative_path.empty() ? root : root + "/" + relative_path;
+#ifdef _MSC_VER
+	WIN32_FIND_DATAA find_data;
+	HANDLE find_handle = FindFirstFileA((directory + "\\*").c_str(), &find_data);
+	if (find_handle == INVALID_HANDLE_VALUE) {
+		LOGE("Unable to read directory %s", directory.c_str());
+		return false;
+	}
+	do {
+		std::string name(find_data.cFileName);
+		if (name == "." || name == "..") continue;
+		std::string path = relative_path.empty() ? name : relative_path + "/" + name;
+		if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			listFiles(root, path, files);
+		} else {
+			files.push_back(path);
+		}
+	} while (FindNextFileA(find_handle, &find_data));
+	FindClose(find_handle);
+#else
+	DIR* dir = opendir(directory.c_str());
+	if (dir == 0) {
+		LOGE("Unable to read directory %s", directory.c_str());
+		return false;
+	}
+	for (struct dirent* entry = readdir(dir); entry; entry = readdir(dir)) {
+		std::string name(entry->d_name);
+		if (name == "." || name == "..") continue;
+		std::string path = relative_path.empty() ? name : relative_path + "/" + name;
+		struct stat file_stat;
+		if (stat((root + "/" + path).c_str(), &file_stat) != 0) continue;
+		if (S_ISDIR(file_stat.st_mode)) {
+			listFiles(root, path, files);
+		} else if (S_ISREG(file_stat.st_mode)) {
+			files.push_back(path);
+		}
+	}
+	closedir(dir);
+#endif
+	return true;
+}
+
+int main(int argc, char** argv) {
+	if (argc != 3) {
+		LOGE("usage: %s <asset directory> <pack file>", argv[0]);
+		return 1;
+	}
+	std::string root(argv[1]);
+	std::vector<std::string> files;
+	if (!listFiles(root, "", files)) {
+		return 2;
+	}
+	// Sorted so the same directory always produces the same pack
+	std::sort(files.begin(), files.end());
+
+	AssetPackWriter writer;
+	size_t total_bytes = 0;
+	for (std::vector<std::string>::iterator it = files.begin(); it != files.end(); ++it) {
+		AssetView view;
+		if (!AssetView::mapFile((root + "/" + *it).c_str(), view)) {
+			LOGE("Unable to read %s", it->c_str());
+			return 3;
+		}
+		writer.add(*it, std::vector<unsigned char>(view.data(), view.data() + view.size()));
+		total_bytes += view.size();
+		LOGI("%s (%lu bytes)", it->c_str(), (unsigned long) view.size());
+	}
+	if (!writer.write(argv[2])) {
+		return 4;
+	}
+	LOGI("Packed %lu files (%lu bytes) into %s", (unsigned long) files.size(), (unsigned long) total_bytes, argv[2]);
+	return 0;
+}